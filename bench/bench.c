@@ -0,0 +1,977 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+  Benchmark of the drawing code.
+
+  Feeds stroke traces through the same calls the input handlers make,
+  drawing into offscreen surfaces without a display, and reports the
+  throughput and memory use of every scenario. Without arguments, a
+  synthetic trace is used. A trace file is either one recorded with
+  --record, see trace.h, or text with one point per line as
+  "x y [width]" and strokes separated by empty lines.
+
+  Afterwards, several devices draw interleaved strokes at once, checking
+  that each keeps its own cairo context and stroke width. Then keeping
+  the window shape up to date while drawing is compared with rebuilding
+  it as often, on growing screens and strokes, see shape.h. Then tool
+  selection through tool tables is compared with the
+  lookup select_tool() made on every button press before, see tools.h.
+  The window shape scanner is compared with
+  gdk_cairo_region_create_from_surface() on the trace drawn at 1080p
+  and 4K, see scan.h.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "main.h"
+#include "drawing.h"
+#include "journal.h"
+#include "tiles.h"
+#include "pool.h"
+#include "trace.h"
+#include "shape.h"
+#include "scan.h"
+#include "tools.h"
+#include "config.h"
+
+#define BENCH_WIDTH  1920
+#define BENCH_HEIGHT 1080
+/* input points per frame, as with a 120 Hz pen on a 60 Hz screen */
+#define BENCH_POINTS_PER_FRAME 2
+#define BENCH_SCANS 10
+#define BENCH_TOOL_ROUNDS 100
+/* pens drawing at the same time */
+#define BENCH_DEVICES 4
+
+typedef struct
+{
+  const gchar         *name;
+  GromitPaintType      type;
+  guint                smooth;
+  GromitArrowPosition  arrowposition;
+  gboolean             undo;
+} BenchScenario;
+
+static const BenchScenario scenarios[] = {
+  { "pen",        GROMIT_PEN,       0, GROMIT_ARROW_AT_NONE, TRUE  },
+  { "pen smooth", GROMIT_PEN,       4, GROMIT_ARROW_AT_NONE, FALSE },
+  { "pen arrows", GROMIT_PEN,       0, GROMIT_ARROW_AT_BOTH, FALSE },
+  { "line",       GROMIT_LINE,      0, GROMIT_ARROW_AT_NONE, FALSE },
+  { "rectangle",  GROMIT_RECTANGLE, 0, GROMIT_ARROW_AT_NONE, FALSE },
+  { "ellipse",    GROMIT_ELLIPSE,   0, GROMIT_ARROW_AT_NONE, FALSE },
+};
+
+/* stands in for the GdkDevice the device data is looked up by */
+static gint bench_device;
+#define BENCH_DEVICE ((GdkDevice *) &bench_device)
+
+
+static void bench_damage (GromitData *data, const GdkRectangle *rect)
+{
+}
+
+
+/* queued segments are flushed by the benchmark loop itself */
+static void bench_schedule (GromitData *data)
+{
+}
+
+
+/* there is no window to shape, shape.c keeps the region all the same */
+static void bench_shape (GromitData *data, cairo_region_t *region)
+{
+}
+
+
+static const GromitDrawingOps bench_drawing_ops = {
+  bench_damage,
+  bench_schedule,
+  bench_shape
+};
+
+/* time spent in and number of window shape updates, see bench_reshape() */
+static gint64 bench_reshape_time;
+static guint bench_reshapes;
+
+
+/* Lissajous figures all over the screen, 3 to 13 px wide. */
+static GPtrArray *trace_synthetic (void)
+{
+  GPtrArray *trace = g_ptr_array_new ();
+  gint s, i;
+
+  for (s = 0; s < 200; s++)
+    {
+      GArray *stroke = g_array_new (FALSE, FALSE, sizeof (GromitStrokeCoordinate));
+
+      for (i = 0; i < 500; i++)
+	{
+	  gdouble t = i / 500.0 * 2 * G_PI;
+	  GromitStrokeCoordinate point;
+
+	  point.x = BENCH_WIDTH / 2 + (BENCH_WIDTH / 2 - 20) * sin (3 * t + s);
+	  point.y = BENCH_HEIGHT / 2 + (BENCH_HEIGHT / 2 - 20) * sin (2 * t + s * 0.37);
+	  point.width = 3 + (s + i / 50) % 11;
+	  point.time = i * 8;
+	  g_array_append_val (stroke, point);
+	}
+
+      g_ptr_array_add (trace, stroke);
+    }
+
+  return trace;
+}
+
+
+static void trace_add_point (GArray *stroke, gdouble x, gdouble y, gdouble pressure, guint32 time)
+{
+  /* as a 7 px pen of 1 px minimum width would draw it */
+  GromitStrokeCoordinate point = {x, y, 1 + CLAMP (pressure, 0, 1) * 6 + 0.5, time};
+  g_array_append_val (stroke, point);
+}
+
+
+/* Turn a recorded trace into strokes, one per press and release of each device. */
+static GPtrArray *trace_parse_recorded (const gchar *contents, gsize length)
+{
+  GPtrArray *trace = g_ptr_array_new ();
+  GArray *strokes[256] = {NULL};
+  gsize offset = sizeof (GromitTraceHeader);
+
+  while (length - offset >= sizeof (GromitTraceRecord))
+    {
+      GromitTraceRecord record;
+      GArray *stroke;
+      guint i;
+
+      memcpy (&record, contents + offset, sizeof (record));
+      offset += sizeof (record);
+      if (length - offset < record.n_history * sizeof (GromitTraceCoord))
+	break;
+
+      if (record.type == GROMIT_TRACE_PRESS)
+	{
+	  strokes[record.device] = g_array_new (FALSE, FALSE, sizeof (GromitStrokeCoordinate));
+	  g_ptr_array_add (trace, strokes[record.device]);
+	}
+
+      stroke = strokes[record.device];
+      for (i = 0; stroke && i < record.n_history; i++)
+	{
+	  GromitTraceCoord coord;
+	  memcpy (&coord, contents + offset + i * sizeof (coord), sizeof (coord));
+	  trace_add_point (stroke, coord.x, coord.y, coord.pressure, coord.time);
+	}
+      offset += record.n_history * sizeof (GromitTraceCoord);
+
+      if (stroke)
+	trace_add_point (stroke, record.x, record.y, record.pressure, record.time);
+
+      if (record.type == GROMIT_TRACE_RELEASE)
+	strokes[record.device] = NULL;
+    }
+
+  return trace;
+}
+
+
+static GPtrArray *trace_load (const gchar *filename)
+{
+  GPtrArray *trace = g_ptr_array_new ();
+  GArray *stroke = NULL;
+  gchar *contents, **lines, **line;
+  gsize length;
+  GError *error = NULL;
+
+  if (!g_file_get_contents (filename, &contents, &length, &error))
+    {
+      g_printerr ("Could not read trace: %s\n", error->message);
+      g_error_free (error);
+      return NULL;
+    }
+
+  if (length >= sizeof (GromitTraceHeader)
+      && memcmp (contents, GROMIT_TRACE_MAGIC, 4) == 0)
+    {
+      g_ptr_array_free (trace, TRUE);
+      trace = trace_parse_recorded (contents, length);
+      g_free (contents);
+      return trace;
+    }
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (line = lines; *line; line++)
+    {
+      GromitStrokeCoordinate point = {0, 0, 7, 0};
+      gint n = sscanf (*line, "%d %d %d", &point.x, &point.y, &point.width);
+
+      if (n < 2)
+	{
+	  stroke = NULL;
+	  continue;
+	}
+
+      if (!stroke)
+	{
+	  stroke = g_array_new (FALSE, FALSE, sizeof (GromitStrokeCoordinate));
+	  g_ptr_array_add (trace, stroke);
+	}
+      point.time = stroke->len * 8;
+      g_array_append_val (stroke, point);
+    }
+
+  g_strfreev (lines);
+  g_free (contents);
+  return trace;
+}
+
+
+static GromitData *bench_data_new (guint width, guint height)
+{
+  GromitData *data = g_new0 (GromitData, 1);
+  GromitDeviceData *devdata = g_new0 (GromitDeviceData, 1);
+
+  data->width = width;
+  data->height = height;
+  /* no window shape to keep up to date */
+  data->composited = TRUE;
+  data->drawing_ops = &bench_drawing_ops;
+
+  surface_pool_resize (data);
+  data->backbuffer = surface_pool_get (data);
+  data->preview = surface_pool_get (data);
+  journal_init (data);
+
+  devdata->device = BENCH_DEVICE;
+  data->devdatatable = g_hash_table_new (NULL, NULL);
+  g_hash_table_insert (data->devdatatable, BENCH_DEVICE, devdata);
+
+  return data;
+}
+
+
+/* Update the window shape as reshape() does, if there is no compositor. */
+static void bench_reshape (GromitData *data)
+{
+  gint64 start;
+
+  if (data->composited)
+    return;
+
+  start = g_get_monotonic_time ();
+  shape_update (data);
+  bench_reshape_time += g_get_monotonic_time () - start;
+  bench_reshapes++;
+}
+
+
+/* Draw one stroke the way on_buttonpress, on_motion and on_buttonrelease do. */
+static guint bench_stroke (GromitData *data,
+			   GromitDeviceData *devdata,
+			   GArray *stroke)
+{
+  GromitStrokeCoordinate *points = (GromitStrokeCoordinate *) stroke->data;
+  gboolean shape = devdata->cur_context->type == GROMIT_LINE
+    || devdata->cur_context->type == GROMIT_RECTANGLE
+    || devdata->cur_context->type == GROMIT_ELLIPSE;
+  guint segments = 0;
+  guint i;
+
+  devdata->maxwidth = points[0].width;
+  devdata->lastx = points[0].x;
+  devdata->lasty = points[0].y;
+  journal_begin_stroke (data, devdata);
+  coord_list_append (data, BENCH_DEVICE, points[0].x, points[0].y, points[0].width, points[0].time);
+
+  for (i = 1; i < stroke->len; i++)
+    {
+      GromitStrokeCoordinate *p = &points[i];
+
+      devdata->maxwidth = p->width;
+
+      if (shape)
+	{
+	  GromitStrokeCoordinate *start = coord_list_first (devdata);
+	  preview_shape (data, BENCH_DEVICE, start->x, start->y, p->x, p->y);
+	  g_array_set_size (devdata->coordlist, 1);
+	}
+      else
+	queue_line (data, BENCH_DEVICE, devdata->lastx, devdata->lasty, p->x, p->y);
+
+      coord_list_append (data, BENCH_DEVICE, p->x, p->y, p->width, p->time);
+      devdata->lastx = p->x;
+      devdata->lasty = p->y;
+
+      if (!devdata->has_preview)
+	draw_arrow_when_applicable (BENCH_DEVICE, devdata, data, GROMIT_ARROW_AT_START);
+
+      if (i % BENCH_POINTS_PER_FRAME == 0)
+	{
+	  segments += flush_all_pending (data);
+	  bench_reshape (data);
+	}
+    }
+
+  queue_finish (data, devdata);
+  segments += flush_all_pending (data);
+
+  if (devdata->has_preview)
+    {
+      preview_commit (data, BENCH_DEVICE);
+      draw_arrow_when_applicable (BENCH_DEVICE, devdata, data, GROMIT_ARROW_AT_START);
+    }
+  draw_arrow_when_applicable (BENCH_DEVICE, devdata, data, GROMIT_ARROW_AT_END);
+
+  cleanup_context (devdata);
+  coord_list_clear (data, BENCH_DEVICE);
+  journal_end_stroke (data, devdata);
+  bench_reshape (data);
+
+  return segments;
+}
+
+
+/*
+  Run a scenario, returning its time per input point in microseconds.
+  The cost column relates that to baseline's, if it is not 0.
+*/
+static gdouble bench_run (const BenchScenario *scenario, GPtrArray *trace, gdouble baseline)
+{
+  GromitData *data = bench_data_new (BENCH_WIDTH, BENCH_HEIGHT);
+  GromitDeviceData *devdata = g_hash_table_lookup (data->devdatatable, BENCH_DEVICE);
+  GdkRGBA color = {0.8, 0.1, 0.1, 0.7};
+  GromitPaintContext tool = {0};
+  guint64 points = 0, segments = 0;
+  gint64 start, elapsed;
+  gdouble cost;
+  guint i, n;
+
+  tool.type = scenario->type;
+  tool.width = 7;
+  tool.minwidth = 1;
+  tool.maxwidth = G_MAXUINT;
+  tool.arrowsize = scenario->arrowposition ? 1 : 0;
+  tool.arrowposition = scenario->arrowposition;
+  tool.smooth = scenario->smooth;
+  tool.paint_color = &color;
+
+  devdata->cur_context = &tool;
+  device_paint_ctx_update (data, devdata);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < trace->len; i++)
+    {
+      GArray *stroke = g_ptr_array_index (trace, i);
+      segments += bench_stroke (data, devdata, stroke);
+      points += stroke->len;
+    }
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+  cost = elapsed / (gdouble) MAX (points, 1);
+
+  g_print ("%-12s %12.0f %12.0f %10" G_GSIZE_FORMAT " %10" G_GSIZE_FORMAT " %9.2fx\n",
+	   scenario->name,
+	   points * (gdouble) G_USEC_PER_SEC / elapsed,
+	   segments * (gdouble) G_USEC_PER_SEC / elapsed,
+	   tiled_surface_get_populated_bytes (data->backbuffer) / 1024,
+	   journal_get_bytes (data) / 1024,
+	   baseline > 0 ? cost / baseline : 1.0);
+
+  if (scenario->undo)
+    {
+      start = g_get_monotonic_time ();
+      for (n = 0; journal_undo (data); n++)
+	;
+      elapsed = MAX (g_get_monotonic_time () - start, 1);
+      g_print ("%-12s %12.0f strokes/s\n", "  undo", n * (gdouble) G_USEC_PER_SEC / elapsed);
+
+      start = g_get_monotonic_time ();
+      for (n = 0; journal_redo (data); n++)
+	;
+      elapsed = MAX (g_get_monotonic_time () - start, 1);
+      g_print ("%-12s %12.0f strokes/s\n", "  redo", n * (gdouble) G_USEC_PER_SEC / elapsed);
+    }
+
+  return cost;
+}
+
+
+/* Scale a stroke of the trace from BENCH_WIDTH x BENCH_HEIGHT to width x height. */
+static GArray *stroke_scaled (GArray *stroke, guint width, guint height)
+{
+  GArray *scaled = g_array_sized_new (FALSE, FALSE, sizeof (GromitStrokeCoordinate), stroke->len);
+  guint i;
+
+  for (i = 0; i < stroke->len; i++)
+    {
+      GromitStrokeCoordinate point = g_array_index (stroke, GromitStrokeCoordinate, i);
+      point.x = point.x * width / BENCH_WIDTH;
+      point.y = point.y * height / BENCH_HEIGHT;
+      g_array_append_val (scaled, point);
+    }
+
+  return scaled;
+}
+
+
+/*
+  Time keeping the window shape up to date without a compositor. Each
+  screen first gets some ink from the trace, then strokes of growing
+  length are drawn across it, updating the shape every frame from what
+  was drawn, as reshape() does. The old way rescanned the whole drawing
+  on every update, so its cost is that of a rebuild times the updates.
+  Both must give the same shape.
+*/
+static gboolean bench_shape_update (GPtrArray *trace)
+{
+  static const struct
+  {
+    const gchar *name;
+    guint        width;
+    guint        height;
+  } screens[] = {
+    { "1080p", 1920, 1080 },
+    { "1440p", 2560, 1440 },
+    { "4K",    3840, 2160 },
+  };
+  static const guint lengths[] = { 50, 200, 800 };
+  GdkRGBA color = {0.8, 0.1, 0.1, 0.7};
+  GromitPaintContext tool = {0};
+  gboolean ok = TRUE;
+  guint s, l, i;
+
+  tool.type = GROMIT_PEN;
+  tool.width = 7;
+  tool.minwidth = 1;
+  tool.maxwidth = G_MAXUINT;
+  tool.paint_color = &color;
+
+  for (s = 0; s < G_N_ELEMENTS (screens); s++)
+    {
+      GromitData *data = bench_data_new (screens[s].width, screens[s].height);
+      GromitDeviceData *devdata = g_hash_table_lookup (data->devdatatable, BENCH_DEVICE);
+
+      data->composited = FALSE;
+      devdata->cur_context = &tool;
+      device_paint_ctx_update (data, devdata);
+      shape_rebuild (data);
+
+      for (i = 0; i < MIN (trace->len, 20); i++)
+	{
+	  GArray *stroke = stroke_scaled (g_ptr_array_index (trace, i), screens[s].width, screens[s].height);
+	  bench_stroke (data, devdata, stroke);
+	  g_array_free (stroke, TRUE);
+	}
+
+      for (l = 0; l < G_N_ELEMENTS (lengths); l++)
+	{
+	  GArray *stroke = g_array_new (FALSE, FALSE, sizeof (GromitStrokeCoordinate));
+	  cairo_region_t *expected;
+	  gint64 start, rebuild;
+
+	  /* a wave from left to right, longer the more points it has */
+	  for (i = 0; i < lengths[l]; i++)
+	    {
+	      GromitStrokeCoordinate point;
+
+	      point.x = screens[s].width / 10 + i * (screens[s].width * 4 / 5) / 800;
+	      point.y = screens[s].height / 2 + screens[s].height / 4 * sin (i / 40.0);
+	      point.width = 7;
+	      point.time = i * 8;
+	      g_array_append_val (stroke, point);
+	    }
+
+	  bench_reshape_time = 0;
+	  bench_reshapes = 0;
+	  bench_stroke (data, devdata, stroke);
+	  g_array_free (stroke, TRUE);
+
+	  expected = cairo_region_copy (data->shape_region);
+	  start = g_get_monotonic_time ();
+	  shape_rebuild (data);
+	  rebuild = g_get_monotonic_time () - start;
+	  ok = ok && cairo_region_equal (expected, data->shape_region);
+
+	  g_print ("%-12s %12u %12.2f %12.2f%s\n", l == 0 ? screens[s].name : "",
+		   lengths[l], bench_reshape_time / 1000.0, rebuild * bench_reshapes / 1000.0,
+		   cairo_region_equal (expected, data->shape_region) ? "" : "  MISMATCH");
+	  cairo_region_destroy (expected);
+	}
+    }
+
+  return ok;
+}
+
+
+/* Whether devdata's state is still that of its own tool and last point. */
+static gboolean bench_device_intact (GromitDeviceData *devdata, guint width)
+{
+  GdkRGBA *color = devdata->cur_context->paint_color;
+  gdouble r, g, b, a;
+
+  if (devdata->maxwidth != width)
+    return FALSE;
+  if (devdata->pending && devdata->pending->len > 0
+      && g_array_index (devdata->pending, GromitSegment, devdata->pending->len - 1).width != width)
+    return FALSE;
+
+  cairo_pattern_get_rgba (cairo_get_source (devdata->paint_ctx), &r, &g, &b, &a);
+  return r == color->red && g == color->green && b == color->blue && a == color->alpha;
+}
+
+
+/* Whether two surfaces of the same size hold the same pixels. */
+static gboolean bench_surfaces_equal (cairo_surface_t *a, cairo_surface_t *b)
+{
+  gint width = cairo_image_surface_get_width (a);
+  gint height = cairo_image_surface_get_height (a);
+  gint y;
+
+  cairo_surface_flush (a);
+  cairo_surface_flush (b);
+
+  for (y = 0; y < height; y++)
+    if (memcmp (cairo_image_surface_get_data (a) + (gsize) y * cairo_image_surface_get_stride (a),
+		cairo_image_surface_get_data (b) + (gsize) y * cairo_image_surface_get_stride (b),
+		width * 4) != 0)
+      return FALSE;
+
+  return TRUE;
+}
+
+
+/*
+  Draw the trace with BENCH_DEVICES pens at once, each with a tool of its
+  own, one point of every device after the other as the events of pens
+  in use at the same time interleave. Each device's points are made
+  distinct in width, so that state leaking from one device to another
+  shows. Every other round the strokes end in reverse order, after which
+  undoing them all must give back the screen from before the round,
+  see journal.h. The check is not timed.
+*/
+static gboolean bench_devices (GPtrArray *trace)
+{
+  static gint devices[BENCH_DEVICES];
+  GromitData *data = bench_data_new (BENCH_WIDTH, BENCH_HEIGHT);
+  GromitDeviceData *devdata[BENCH_DEVICES];
+  GromitPaintContext tools[BENCH_DEVICES];
+  GdkRGBA colors[BENCH_DEVICES];
+  guint64 points = 0;
+  gboolean ok = TRUE;
+  gint64 start, elapsed, checking = 0;
+  guint i, j, k, len;
+
+  for (k = 0; k < BENCH_DEVICES; k++)
+    {
+      GdkDevice *device = (GdkDevice *) &devices[k];
+
+      colors[k] = (GdkRGBA) {0.2 * k, 0.1, 1 - 0.2 * k, 0.7};
+      memset (&tools[k], 0, sizeof (GromitPaintContext));
+      tools[k].type = GROMIT_PEN;
+      tools[k].width = 7;
+      tools[k].minwidth = 1;
+      tools[k].maxwidth = G_MAXUINT;
+      tools[k].paint_color = &colors[k];
+
+      devdata[k] = g_new0 (GromitDeviceData, 1);
+      devdata[k]->device = device;
+      devdata[k]->index = k;
+      devdata[k]->cur_context = &tools[k];
+      g_hash_table_insert (data->devdatatable, device, devdata[k]);
+      device_paint_ctx_update (data, devdata[k]);
+    }
+
+  for (k = 1; k < BENCH_DEVICES; k++)
+    for (j = 0; j < k; j++)
+      if (devdata[k]->paint_ctx == devdata[j]->paint_ctx)
+	ok = FALSE;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i + BENCH_DEVICES <= trace->len; i += BENCH_DEVICES)
+    {
+      gboolean reverse = (i / BENCH_DEVICES) % 2;
+      gboolean check = reverse;
+      cairo_surface_t *before = NULL;
+
+      /* strokes of a single point add nothing to undo */
+      for (k = 0; k < BENCH_DEVICES; k++)
+	if (((GArray *) g_ptr_array_index (trace, i + k))->len < 2)
+	  check = FALSE;
+
+      if (check)
+	{
+	  gint64 t = g_get_monotonic_time ();
+	  before = surface_pool_get (data);
+	  tiled_surface_copy (before, data->backbuffer);
+	  checking += g_get_monotonic_time () - t;
+	}
+
+      len = 0;
+      for (k = 0; k < BENCH_DEVICES; k++)
+	{
+	  GArray *stroke = g_ptr_array_index (trace, i + k);
+	  GromitStrokeCoordinate *p = &g_array_index (stroke, GromitStrokeCoordinate, 0);
+
+	  devdata[k]->maxwidth = p->width + 16 * k;
+	  devdata[k]->lastx = p->x;
+	  devdata[k]->lasty = p->y;
+	  journal_begin_stroke (data, devdata[k]);
+	  coord_list_append (data, devdata[k]->device, p->x, p->y, devdata[k]->maxwidth, p->time);
+	  len = MAX (len, stroke->len);
+	}
+
+      for (j = 1; j < len; j++)
+	{
+	  for (k = 0; k < BENCH_DEVICES; k++)
+	    {
+	      GArray *stroke = g_ptr_array_index (trace, i + k);
+	      GromitStrokeCoordinate *p;
+
+	      if (j >= stroke->len)
+		continue;
+
+	      p = &g_array_index (stroke, GromitStrokeCoordinate, j);
+	      devdata[k]->maxwidth = p->width + 16 * k;
+	      queue_line (data, devdata[k]->device, devdata[k]->lastx, devdata[k]->lasty, p->x, p->y);
+	      coord_list_append (data, devdata[k]->device, p->x, p->y, devdata[k]->maxwidth, p->time);
+	      devdata[k]->lastx = p->x;
+	      devdata[k]->lasty = p->y;
+	      points++;
+	    }
+
+	  /* the others must not have touched any device's state */
+	  for (k = 0; k < BENCH_DEVICES; k++)
+	    {
+	      GArray *stroke = g_ptr_array_index (trace, i + k);
+	      GromitStrokeCoordinate *p = &g_array_index (stroke, GromitStrokeCoordinate, MIN (j, stroke->len - 1));
+	      if (!bench_device_intact (devdata[k], p->width + 16 * k))
+		ok = FALSE;
+	    }
+
+	  if (j % BENCH_POINTS_PER_FRAME == 0)
+	    flush_all_pending (data);
+	}
+
+      for (k = 0; k < BENCH_DEVICES; k++)
+	queue_finish (data, devdata[k]);
+      flush_all_pending (data);
+
+      for (k = 0; k < BENCH_DEVICES; k++)
+	{
+	  GromitDeviceData *ending = devdata[reverse ? BENCH_DEVICES - 1 - k : k];
+	  cleanup_context (ending);
+	  coord_list_clear (data, ending->device);
+	  journal_end_stroke (data, ending);
+	}
+
+      if (check)
+	{
+	  gint64 t = g_get_monotonic_time ();
+
+	  for (k = 0; k < BENCH_DEVICES; k++)
+	    journal_undo (data);
+	  if (!bench_surfaces_equal (before, data->backbuffer))
+	    ok = FALSE;
+	  for (k = 0; k < BENCH_DEVICES; k++)
+	    journal_redo (data);
+	  flush_all_pending (data);
+
+	  surface_pool_put (data, before);
+	  checking += g_get_monotonic_time () - t;
+	}
+    }
+  elapsed = MAX (g_get_monotonic_time () - start - checking, 1);
+
+  g_print ("%-12s %12.0f %12s %10" G_GSIZE_FORMAT " %10" G_GSIZE_FORMAT "%s\n",
+	   "devices", points * (gdouble) G_USEC_PER_SEC / elapsed, "",
+	   tiled_surface_get_populated_bytes (data->backbuffer) / 1024,
+	   journal_get_bytes (data) / 1024,
+	   ok ? "" : "  MISMATCH");
+
+  return ok;
+}
+
+
+/* Look up the config's tool for the "|Xy" suffix of the given bits, as select_tool() did. */
+static GromitPaintContext *bench_lookup_names (GromitData *data,
+					       guchar **names,
+					       guint *lens,
+					       guint buttons,
+					       guint modifier)
+{
+  GromitPaintContext *context;
+  guint k;
+
+  for (k = 0; k < 3; k++)
+    {
+      names[k][lens[k]] = 124;
+      names[k][lens[k] + 1] = buttons + 64;
+      names[k][lens[k] + 2] = modifier + 48;
+      names[k][lens[k] + 3] = 0;
+
+      if ((context = g_hash_table_lookup (data->tool_config, names[k])))
+	return context;
+    }
+
+  return NULL;
+}
+
+
+/* The lookup chain select_tool() went through on every button press before tool tables. */
+static GromitPaintContext *bench_lookup_chain (GromitData *data,
+					       const gchar *device_name,
+					       const gchar *slave_name,
+					       guint state,
+					       gboolean extra)
+{
+  const gchar *base[3] = { slave_name, device_name, DEFAULT_DEVICE_NAME };
+  guint req_buttons = (state >> 8) & 31, req_modifier = (state >> 1) & 7;
+  GromitPaintContext *context = NULL, *found;
+  guchar *names[3];
+  guint lens[3];
+  guint i, j, k;
+
+  if (state & GDK_SHIFT_MASK) req_modifier |= 1;
+
+  for (k = 0; k < 3; k++)
+    {
+      lens[k] = strlen (base[k]);
+      names[k] = (guchar *) g_strndup (base[k], lens[k] + 3);
+    }
+
+  for (i = 0; i <= req_buttons; i++)
+    {
+      if (i > 0 && (i & req_buttons) != i)
+	continue;
+
+      for (j = 0; ; j++)
+	{
+	  if ((found = bench_lookup_names (data, names, lens, i, req_modifier & ((1 << j) - 1))))
+	    context = found;
+	  if (!(j <= 3 && req_modifier >= (1u << j)))
+	    break;
+	}
+    }
+
+  if (!req_modifier && extra && (found = bench_lookup_names (data, names, lens, 0, 8)))
+    context = found;
+
+  for (k = 0; k < 3; k++)
+    g_free (names[k]);
+
+  return context;
+}
+
+
+/*
+  Time tool selection for every button and modifier state of a device,
+  with the default config plus a tool of its own, both through the
+  lookup chain and through a tool table, and the table's build on the
+  first press.
+*/
+static gboolean bench_tools (void)
+{
+  static const struct
+  {
+    const gchar *name;
+    guint        buttons;
+    guint        modifier;
+  } config[] = {
+    { DEFAULT_DEVICE_NAME, 0, 0 },
+    { DEFAULT_DEVICE_NAME, 0, 1 },
+    { DEFAULT_DEVICE_NAME, 0, 2 },
+    { DEFAULT_DEVICE_NAME, 0, 3 },
+    { DEFAULT_DEVICE_NAME, 0, 8 },
+    { "bench pen",         1, 0 },
+  };
+  static GromitPaintContext tools[G_N_ELEMENTS (config)];
+  GromitData *data = g_new0 (GromitData, 1);
+  GromitToolTable table;
+  gdouble chain, build, lookup;
+  gboolean ok = TRUE;
+  gint64 start;
+  guint i, r, state, extra;
+
+  data->tool_config = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; i < G_N_ELEMENTS (config); i++)
+    g_hash_table_insert (data->tool_config,
+			 g_strdup_printf ("%s|%c%c", config[i].name,
+					  config[i].buttons + 64, config[i].modifier + 48),
+			 &tools[i]);
+
+  /* states cover all 32 button and 16 modifier combinations */
+  start = g_get_monotonic_time ();
+  for (r = 0; r < BENCH_TOOL_ROUNDS; r++)
+    for (state = 0; state < 32 << 8; state++)
+      if (!(state & 0xf0))
+	for (extra = 0; extra < 2; extra++)
+	  bench_lookup_chain (data, "Virtual core pointer", "bench pen", state, extra);
+  chain = (g_get_monotonic_time () - start) / (gdouble) (BENCH_TOOL_ROUNDS * 32 * 16 * 2);
+
+  start = g_get_monotonic_time ();
+  for (r = 0; r < BENCH_TOOL_ROUNDS; r++)
+    tool_table_build (data, &table, "Virtual core pointer", "bench pen");
+  build = (g_get_monotonic_time () - start) / (gdouble) BENCH_TOOL_ROUNDS;
+
+  start = g_get_monotonic_time ();
+  for (r = 0; r < BENCH_TOOL_ROUNDS; r++)
+    for (state = 0; state < 32 << 8; state++)
+      if (!(state & 0xf0))
+	for (extra = 0; extra < 2; extra++)
+	  tool_table_lookup (&table, state, extra);
+  lookup = (g_get_monotonic_time () - start) / (gdouble) (BENCH_TOOL_ROUNDS * 32 * 16 * 2);
+
+  for (state = 0; state < 32 << 8; state++)
+    if (!(state & 0xf0))
+      for (extra = 0; extra < 2; extra++)
+	if (tool_table_lookup (&table, state, extra)
+	    != bench_lookup_chain (data, "Virtual core pointer", "bench pen", state, extra))
+	  ok = FALSE;
+
+  g_print ("%-12s %12.3f us per press\n", "  chain", chain);
+  g_print ("%-12s %12.3f us per table\n", "  build", build);
+  g_print ("%-12s %12.3f us per press%s\n", "  table", lookup, ok ? "" : "  MISMATCH");
+
+  return ok;
+}
+
+
+/* Milliseconds per scan of the whole surface with impl, -1 meaning GDK. */
+static gdouble bench_scan_time (cairo_surface_t *surface, gint impl, cairo_region_t **region)
+{
+  cairo_rectangle_int_t all = {0, 0,
+			       cairo_image_surface_get_width (surface),
+			       cairo_image_surface_get_height (surface)};
+  gint64 start = g_get_monotonic_time ();
+  gint i;
+
+  for (i = 0; i < BENCH_SCANS; i++)
+    {
+      if (*region)
+	cairo_region_destroy (*region);
+      if (impl < 0)
+	*region = gdk_cairo_region_create_from_surface (surface);
+      else
+	*region = scan_alpha_region_with (impl, surface, &all);
+    }
+
+  return (g_get_monotonic_time () - start) / 1000.0 / BENCH_SCANS;
+}
+
+
+/* Draw the trace scaled to width x height and scan it with every implementation. */
+static gboolean bench_scan (const gchar *name, gint width, gint height, GPtrArray *trace)
+{
+  cairo_surface_t *surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  cairo_t *cr = cairo_create (surface);
+  cairo_region_t *expected = NULL;
+  gboolean ok = TRUE;
+  gdouble reference;
+  gint impl;
+  guint i, j;
+
+  /* the same translucent, antialiased ink the app paints with */
+  cairo_scale (cr, width / (gdouble) BENCH_WIDTH, height / (gdouble) BENCH_HEIGHT);
+  cairo_set_source_rgba (cr, 0.8, 0.1, 0.1, 0.7);
+  cairo_set_line_cap (cr, CAIRO_LINE_CAP_ROUND);
+  for (i = 0; i < trace->len; i++)
+    {
+      GArray *stroke = g_ptr_array_index (trace, i);
+      GromitStrokeCoordinate *points = (GromitStrokeCoordinate *) stroke->data;
+
+      for (j = 1; j < stroke->len; j++)
+	{
+	  cairo_set_line_width (cr, points[j].width);
+	  cairo_move_to (cr, points[j - 1].x, points[j - 1].y);
+	  cairo_line_to (cr, points[j].x, points[j].y);
+	  cairo_stroke (cr);
+	}
+    }
+  cairo_destroy (cr);
+
+  reference = bench_scan_time (surface, -1, &expected);
+  g_print ("%-12s %12.2f %12.1f %10d\n", name, reference, 1.0,
+	   cairo_region_num_rectangles (expected));
+
+  for (impl = GROMIT_SCAN_SCALAR; impl <= (gint) scan_get_impl (); impl++)
+    {
+      cairo_region_t *region = NULL;
+      gdouble t = bench_scan_time (surface, impl, &region);
+      gchar *label = g_strdup_printf ("  %s", scan_impl_name (impl));
+
+      g_print ("%-12s %12.2f %12.1f %10d%s\n", label, t, reference / MAX (t, 0.001),
+	       cairo_region_num_rectangles (region),
+	       cairo_region_equal (region, expected) ? "" : "  MISMATCH");
+      ok = ok && cairo_region_equal (region, expected);
+
+      g_free (label);
+      cairo_region_destroy (region);
+    }
+
+  cairo_region_destroy (expected);
+  cairo_surface_destroy (surface);
+  return ok;
+}
+
+
+int main (int argc, char **argv)
+{
+  GPtrArray *trace;
+  gdouble baseline;
+  guint i;
+
+  if (argc > 1)
+    trace = trace_load (argv[1]);
+  else
+    trace = trace_synthetic ();
+
+  if (!trace)
+    return 1;
+
+  g_print ("%-12s %12s %12s %10s %10s %10s\n", "scenario", "points/s", "segments/s", "ink KiB", "undo KiB", "cost");
+
+  /* the cost per point relative to the plain pen, e.g. what smoothing adds */
+  baseline = bench_run (&scenarios[0], trace, 0);
+  for (i = 1; i < G_N_ELEMENTS (scenarios); i++)
+    bench_run (&scenarios[i], trace, baseline);
+
+  if (!bench_devices (trace))
+    return 1;
+
+  g_print ("\n%-12s %12s %12s %12s\n", "shape update", "points", "updates ms", "rebuilds ms");
+  if (!bench_shape_update (trace))
+    return 1;
+
+  g_print ("\n%s\n", "tool lookup");
+  if (!bench_tools ())
+    return 1;
+
+  g_print ("\n%-12s %12s %12s %10s\n", "shape scan", "ms", "speedup", "rects");
+  if (!bench_scan ("1080p", 1920, 1080, trace)
+      || !bench_scan ("4K", 3840, 2160, trace))
+    return 1;
+
+  return 0;
+}
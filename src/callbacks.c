@@ -29,24 +29,52 @@
 #include "callbacks.h"
 #include "config.h"
 #include "drawing.h"
+#include "shape.h"
+#include "tiles.h"
+#include "journal.h"
+#include "pool.h"
+#include "sampler.h"
+#include "latency.h"
+#include "trace.h"
+#include "profile.h"
 #include "build-config.h"
 
 
+static void add_tile_to_path (const GdkRectangle *tile, gpointer user_data)
+{
+  cairo_rectangle ((cairo_t *) user_data, tile->x, tile->y, tile->width, tile->height);
+}
+
+
 gboolean on_expose (GtkWidget *widget,
 		    cairo_t* cr,
 		    gpointer user_data)
 {
   GromitData *data = (GromitData *) user_data;
 
-  if(data->debug)
-    g_printerr("DEBUG: got draw event\n");
+  GROMIT_TRACE (data, GROMIT_LOG_DRAW, "got draw event");
+
+  GROMIT_PROFILE_BEGIN (data, "on_expose");
 
   cairo_save (cr);
-  cairo_set_source_surface (cr, data->backbuffer, 0, 0);
+  cairo_set_source_rgba (cr, 0, 0, 0, 0);
   cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
   cairo_paint (cr);
+  /* only tiles that hold something need to be copied over */
+  cairo_set_source_surface (cr, data->backbuffer, 0, 0);
+  tiled_surface_foreach (data->backbuffer, NULL, add_tile_to_path, cr);
+  cairo_fill (cr);
+  /* shapes that are still being dragged go on top */
+  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+  cairo_set_source_surface (cr, data->preview, 0, 0);
+  tiled_surface_foreach (data->preview, NULL, add_tile_to_path, cr);
+  cairo_fill (cr);
   cairo_restore (cr);
 
+  latency_displayed (data);
+
+  GROMIT_PROFILE_END (data, "on_expose", NULL, -1);
+
   return TRUE;
 }
 
@@ -59,8 +87,7 @@ gboolean on_configure (GtkWidget *widget,
 {
   GromitData *data = (GromitData *) user_data;
 
-  if(data->debug)
-    g_printerr("DEBUG: got configure event\n");
+  GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "got configure event");
 
   return TRUE;
 }
@@ -73,8 +100,7 @@ void on_screen_changed(GtkWidget *widget,
 {
   GromitData *data = (GromitData *) user_data;
 
-  if(data->debug)
-    g_printerr("DEBUG: got screen-changed event\n");
+  GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "got screen-changed event");
 
   GdkScreen *screen = gtk_widget_get_screen(GTK_WIDGET (widget));
   GdkVisual *visual = gdk_screen_get_rgba_visual(screen);
@@ -90,55 +116,57 @@ void on_monitors_changed ( GdkScreen *screen,
 			   gpointer   user_data)
 {
   GromitData *data = (GromitData *) user_data;
+  cairo_region_t *monitors = monitor_region_new (data);
+  guint width = gdk_screen_get_width (data->screen);
+  guint height = gdk_screen_get_height (data->screen);
 
-  // get new sizes
-  data->width = gdk_screen_get_width (data->screen);
-  data->height = gdk_screen_get_height (data->screen);
+  data->xinerama = gdk_screen_get_n_monitors (data->screen) > 1;
 
-  if(data->debug)
-    g_printerr("DEBUG: screen size changed to %d x %d!\n", data->width, data->height);
+  GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "screen size changed to %u x %u, %d monitors!",
+	       width, height, gdk_screen_get_n_monitors (data->screen));
 
-  // change size
-  gtk_widget_set_size_request(GTK_WIDGET(data->win), data->width, data->height);
   // try to set transparent for input
   cairo_region_t* r =  cairo_region_create();
   gtk_widget_input_shape_combine_region(data->win, r);
   cairo_region_destroy(r);
 
-  /* recreate the shape surface */
-  cairo_surface_t *new_shape = cairo_image_surface_create(CAIRO_FORMAT_ARGB32 ,data->width, data->height);
-  cairo_t *cr = cairo_create (new_shape);
-  cairo_set_source_surface (cr, data->backbuffer, 0, 0);
-  cairo_paint (cr);
-  cairo_destroy (cr);
-  cairo_surface_destroy(data->backbuffer);
-  data->backbuffer = new_shape;
-
   /*
-     these depend on the shape surface
+    Drawings go away with the monitor they were on, those on the other
+    monitors are left alone. Only populated tiles are ever touched.
   */
-  GHashTableIter it;
-  gpointer value;
-  g_hash_table_iter_init (&it, data->tool_config);
-  while (g_hash_table_iter_next (&it, NULL, &value))
-    paint_context_free(value);
-  g_hash_table_remove_all(data->tool_config);
+  flush_all_pending (data);
+  cairo_region_intersect (data->monitors, monitors);
+  tiled_surface_clip (data->backbuffer, data->monitors);
+  tiled_surface_clip (data->preview, data->monitors);
+  journal_clip (data, data->monitors);
+  cairo_region_destroy (data->monitors);
+  data->monitors = monitors;
+
+  if (width != data->width || height != data->height)
+    {
+      data->width = width;
+      data->height = height;
 
+      // change size
+      gtk_widget_set_size_request(GTK_WIDGET(data->win), data->width, data->height);
 
-  parse_config(data); // also calls paint_context_new() :-(
+      /* resize the shape surface, its tiles are kept rather than copied */
+      surface_pool_resize (data);
+      data->backbuffer = tiled_surface_resize (data->backbuffer, data->width, data->height);
+      journal_resize (data);
 
+      /* previews are redrawn on the next motion anyway */
+      surface_pool_put (data, data->preview);
+      data->preview = surface_pool_get (data);
 
-  data->default_pen = paint_context_new (data, GROMIT_PEN,
-					 data->red, 7, 0, GROMIT_ARROW_AT_NONE, 1, G_MAXUINT);
-  data->default_eraser = paint_context_new (data, GROMIT_ERASER,
-					    data->red, 75, 0, GROMIT_ARROW_AT_NONE, 1, G_MAXUINT);
+      /* the paint contexts draw onto the shape surface */
+      paint_contexts_retarget (data);
+    }
+
+  gdk_window_invalidate_rect(gtk_widget_get_window(data->win), NULL, 0);
 
   if(!data->composited) // set shape
-    {
-      cairo_region_t* r = gdk_cairo_region_create_from_surface(data->backbuffer);
-      gtk_widget_shape_combine_region(data->win, r);
-      cairo_region_destroy(r);
-    }
+    shape_rebuild(data);
 
   setup_input_devices(data);
 
@@ -153,8 +181,7 @@ void on_composited_changed ( GdkScreen *screen,
 {
   GromitData *data = (GromitData *) user_data;
 
-  if(data->debug)
-    g_printerr("DEBUG: got composited-changed event\n");
+  GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "got composited-changed event");
 
   data->composited = gdk_screen_is_composited (data->screen);
 
@@ -165,15 +192,18 @@ void on_composited_changed ( GdkScreen *screen,
       // re-apply transparency
       gtk_widget_set_opacity(data->win, 0.75);
     }
+  else
+    shape_rebuild(data);
 
   // set anti-aliasing
   GHashTableIter it;
   gpointer value;
-  g_hash_table_iter_init (&it, data->tool_config);
+  g_hash_table_iter_init (&it, data->devdatatable);
   while (g_hash_table_iter_next (&it, NULL, &value))
     {
-      GromitPaintContext *context = value;
-      cairo_set_antialias(context->paint_ctx, data->composited ? CAIRO_ANTIALIAS_DEFAULT : CAIRO_ANTIALIAS_NONE);
+      GromitDeviceData *devdata = value;
+      if (devdata->paint_ctx)
+	cairo_set_antialias(devdata->paint_ctx, data->composited ? CAIRO_ANTIALIAS_DEFAULT : CAIRO_ANTIALIAS_NONE);
     }
 
 
@@ -193,8 +223,7 @@ void on_clientapp_selection_get (GtkWidget          *widget,
 
   gchar *ans = "";
 
-  if(data->debug)
-    g_printerr("DEBUG: clientapp received request.\n");
+  GROMIT_DEBUG (data, GROMIT_LOG_IPC, "clientapp received request.");
 
   GdkAtom action;
   action = gtk_selection_data_get_target(selection_data);
@@ -224,6 +253,11 @@ void on_clientapp_selection_received (GtkWidget *widget,
   else
     data->client = 1;
 
+  if (gtk_selection_data_get_target(selection_data) == GA_STATS
+      && gtk_selection_data_get_length(selection_data) > 0)
+    g_print ("%.*s", gtk_selection_data_get_length(selection_data),
+	     (const gchar *) gtk_selection_data_get_data(selection_data));
+
   gtk_main_quit ();
 }
 
@@ -232,6 +266,61 @@ void on_clientapp_selection_received (GtkWidget *widget,
 static float line_thickener = 0;
 
 
+static void apply_event_compression (GromitData *data)
+{
+  gdk_window_set_event_compression (gtk_widget_get_window (data->win),
+				    !data->compression_adaptive
+				    || data->compression != GROMIT_COMPRESS_NONE);
+}
+
+
+/*
+  Pick the event compression for pens from how long painting a frame
+  takes, so that fast machines get every event and slow ones do not fall
+  behind the pen.
+*/
+static void render_cost_update (GromitData *data,
+				GdkFrameClock *clock,
+				gint64 cost)
+{
+  static const gchar *names[] = { "off", "on with history catch-up", "on" };
+  GromitCompression compression = data->compression;
+  gint64 now = gdk_frame_clock_get_frame_time (clock);
+  gint64 interval = 0, budget;
+
+  /* moving average over roughly the last eight frames */
+  data->render_cost += (cost - data->render_cost) / 8;
+
+  gdk_frame_clock_get_refresh_info (clock, now, &interval, NULL);
+  if (interval <= 0)
+    interval = G_USEC_PER_SEC / 60;
+  /* leave the rest of the frame to input handling and the compositor */
+  budget = interval / 2;
+
+  /* give the average time to follow the last change */
+  if (now - data->compression_since < G_USEC_PER_SEC / 2)
+    return;
+
+  if (data->render_cost > budget && compression < GROMIT_COMPRESS_FULL)
+    compression++;
+  else if (data->render_cost < budget / 4 && compression > GROMIT_COMPRESS_NONE)
+    compression--;
+
+  if (compression == data->compression)
+    return;
+
+  GROMIT_DEBUG (data, GROMIT_LOG_INPUT,
+		"Rendering takes %" G_GINT64_FORMAT " us of a %" G_GINT64_FORMAT
+		" us budget, pen event compression %s",
+		data->render_cost, budget, names[compression]);
+
+  data->compression = compression;
+  data->compression_since = now;
+  if (data->compression_adaptive)
+    apply_event_compression (data);
+}
+
+
 gboolean on_buttonpress (GtkWidget *win,
 			 GdkEventButton *ev,
 			 gpointer user_data)
@@ -242,63 +331,103 @@ gboolean on_buttonpress (GtkWidget *win,
   /* get the data for this device */
   GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, ev->device);
 
-  if(data->debug)
-    g_printerr("DEBUG: Device '%s': Button %i Down State %d at (x,y)=(%.2f : %.2f)\n",
+  GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "Device '%s': Button %i Down State %d at (x,y)=(%.2f : %.2f)",
 	       gdk_device_get_name(ev->device), ev->button, ev->state, ev->x, ev->y);
 
   if (!devdata->is_grabbed)
     return FALSE;
 
-  if (gdk_device_get_source(gdk_event_get_source_device((GdkEvent *)ev)) == GDK_SOURCE_PEN) {
-      /* Do not drop unprocessed motion events. Smoother drawing for pens of tablets. */
-      gdk_window_set_event_compression(gtk_widget_get_window(data->win), FALSE);
-  } else {
-      /* For all other source types, set back to default. Otherwise, lines were only
-	 fully drawn to the end on button release. */
-      gdk_window_set_event_compression(gtk_widget_get_window(data->win), TRUE);
-  }
+  data->counters.events++;
+
+  trace_record_event (data, devdata, GROMIT_TRACE_PRESS, (GdkEvent *) ev);
 
   /* See GdkModifierType. Am I fixing a Gtk misbehaviour???  */
   ev->state |= 1 << (ev->button + 7);
   select_tool (data, ev->device, gdk_event_get_source_device ((GdkEvent *) ev), ev->state);
 
+  /* Pens of tablets draw smoother with every motion event, as long as we
+     keep up rendering them, see render_cost_update(). Smoothing tools get
+     by with fewer events. For all other source types, keep the default.
+     Otherwise, lines were only fully drawn to the end on button release. */
+  data->compression_adaptive =
+    gdk_device_get_source(gdk_event_get_source_device((GdkEvent *)ev)) == GDK_SOURCE_PEN
+    && devdata->cur_context->smooth == 0;
+  apply_event_compression (data);
+
   devdata->lastx = ev->x;
   devdata->lasty = ev->y;
   devdata->motion_time = ev->time;
 
-  switch (devdata->cur_context->type)
-  {
-  case GROMIT_LINE:
-  case GROMIT_ELLIPSE:
-  case GROMIT_RECTANGLE:
-    if(data->motionbuffer) cairo_surface_destroy(data->motionbuffer);
-    data->motionbuffer = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, data->width, data->height);
-    copy_surface (data->motionbuffer, data->backbuffer);
-    break;
-  default:
-    break;
-  }
-
-  snap_undo_state (data);
+  journal_begin_stroke (data, devdata);
 
   gdk_event_get_axis ((GdkEvent *) ev, GDK_AXIS_PRESSURE, &pressure);
-  data->maxwidth = (CLAMP (pressure + line_thickener, 0, 1) *
+  devdata->maxwidth = (CLAMP (pressure + line_thickener, 0, 1) *
 		    (double) (devdata->cur_context->width -
 			      devdata->cur_context->minwidth) +
 		    devdata->cur_context->minwidth);
 
-  if(data->maxwidth > devdata->cur_context->maxwidth)
-    data->maxwidth = devdata->cur_context->maxwidth;
+  if(devdata->maxwidth > devdata->cur_context->maxwidth)
+    devdata->maxwidth = devdata->cur_context->maxwidth;
 
   if (ev->button <= 5)
-    draw_line (data, ev->device, ev->x, ev->y, ev->x, ev->y);
+    switch (devdata->cur_context->type)
+    {
+    case GROMIT_LINE:
+    case GROMIT_ELLIPSE:
+    case GROMIT_RECTANGLE:
+      preview_shape (data, ev->device, ev->x, ev->y, ev->x, ev->y);
+      break;
+    default:
+      queue_line (data, ev->device, ev->x, ev->y, ev->x, ev->y);
+      break;
+    }
 
-  coord_list_prepend (data, ev->device, ev->x, ev->y, data->maxwidth);
+  coord_list_append (data, ev->device, ev->x, ev->y, devdata->maxwidth, ev->time);
 
   return TRUE;
 }
 
 
+/* Draw to a point that was passed on the way to the current event. */
+static void history_point (GromitData *data,
+			   GromitDeviceData *devdata,
+			   gdouble x, gdouble y,
+			   gdouble pressure,
+			   guint32 time)
+{
+  trace_record_history (data, x, y, pressure, time);
+
+  if (pressure <= 0)
+    return;
+
+  devdata->maxwidth = (CLAMP (pressure + line_thickener, 0, 1) *
+		    (double) (devdata->cur_context->width -
+			      devdata->cur_context->minwidth) +
+		    devdata->cur_context->minwidth);
+
+  if(devdata->maxwidth > devdata->cur_context->maxwidth)
+    devdata->maxwidth = devdata->cur_context->maxwidth;
+
+  if (!devdata->has_preview)
+    queue_line (data, devdata->device, devdata->lastx, devdata->lasty, x, y);
+
+  coord_list_append (data, devdata->device, x, y, devdata->maxwidth, time);
+  devdata->lastx = x;
+  devdata->lasty = y;
+}
+
+
+/*
+  Whether the input thread has samples of the device from before time.
+  It only has them for devices with absolute axes.
+*/
+static gboolean has_samples (GromitDeviceData *devdata, guint32 time)
+{
+  return devdata->samples && devdata->samples->len > 0
+    && g_array_index (devdata->samples, GromitSample, 0).time < time;
+}
+
+
 gboolean on_motion (GtkWidget *win,
 		    GdkEventMotion *ev,
 		    gpointer user_data)
@@ -308,54 +437,84 @@ gboolean on_motion (GtkWidget *win,
   gint nevents;
   int i;
   gdouble pressure = 1;
+  GArray *history;
+  gint points = 1;
   /* get the data for this device */
   GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, ev->device);
 
   if (!devdata->is_grabbed)
     return FALSE;
 
-  if(data->debug)
-      g_printerr("DEBUG: Device '%s': motion to (x,y)=(%.2f : %.2f)\n", gdk_device_get_name(ev->device), ev->x, ev->y);
+  data->counters.events++;
+
+  GROMIT_PROFILE_BEGIN (data, "on_motion");
+
+  GROMIT_TRACE (data, GROMIT_LOG_INPUT, "Device '%s': motion to (x,y)=(%.2f : %.2f)", gdk_device_get_name(ev->device), ev->x, ev->y);
 
   select_tool (data, ev->device, gdk_event_get_source_device ((GdkEvent *) ev), ev->state);
 
-  gdk_device_get_history (ev->device, ev->window,
-			  devdata->motion_time, ev->time,
-			  &coords, &nevents);
+  collect_samples (data);
 
-  if(!data->xinerama && nevents > 0)
+  if ((history = trace_replay_history (data)))
     {
-      for (i=0; i < nevents; i++)
+      for (i = 0; i < (int) history->len; i++)
         {
-          gdouble x, y;
+          GromitTraceCoord *coord = &g_array_index (history, GromitTraceCoord, i);
+          history_point (data, devdata, coord->x, coord->y, coord->pressure, coord->time);
+        }
+      points += history->len;
+    }
+  else if (has_samples (devdata, ev->time))
+    {
+      /* the input thread's samples stand in for the motion history,
+         unless rendering cannot keep up, see render_cost_update() */
+      gdouble dx = ev->x_root - ev->x, dy = ev->y_root - ev->y;
+      gboolean shed = data->compression_adaptive
+	&& data->compression == GROMIT_COMPRESS_FULL;
 
-          gdk_device_get_axis (ev->device, coords[i]->axes,
-                               GDK_AXIS_PRESSURE, &pressure);
-          if (pressure > 0)
+      for (i = 0; i < (int) devdata->samples->len; i++)
+        {
+          GromitSample *sample = &g_array_index (devdata->samples, GromitSample, i);
+          /* the event's own point is drawn below */
+          if (sample->time >= ev->time)
+            break;
+          if (sample->time > devdata->motion_time && !shed)
             {
-	      data->maxwidth = (CLAMP (pressure + line_thickener, 0, 1) *
-				(double) (devdata->cur_context->width -
-					  devdata->cur_context->minwidth) +
-				devdata->cur_context->minwidth);
-
-	      if(data->maxwidth > devdata->cur_context->maxwidth)
-		data->maxwidth = devdata->cur_context->maxwidth;
-
-              gdk_device_get_axis(ev->device, coords[i]->axes,
-                                  GDK_AXIS_X, &x);
-              gdk_device_get_axis(ev->device, coords[i]->axes,
-                                  GDK_AXIS_Y, &y);
-
-	      draw_line (data, ev->device, devdata->lastx, devdata->lasty, x, y);
-
-              coord_list_prepend (data, ev->device, x, y, data->maxwidth);
-              devdata->lastx = x;
-              devdata->lasty = y;
+              history_point (data, devdata, sample->x - dx, sample->y - dy,
+                             sample->pressure < 0 ? 1 : sample->pressure, sample->time);
+              points++;
             }
         }
-
-      devdata->motion_time = coords[nevents-1]->time;
-      g_free (coords);
+      if (i > 0)
+        g_array_remove_range (devdata->samples, 0, i);
+    }
+  else if (!data->compression_adaptive
+	   || data->compression == GROMIT_COMPRESS_CATCHUP)
+    {
+      gdk_device_get_history (ev->device, ev->window,
+			      devdata->motion_time, ev->time,
+			      &coords, &nevents);
+
+      if(!data->xinerama && nevents > 0)
+	{
+	  for (i=0; i < nevents; i++)
+	    {
+	      gdouble x, y;
+
+	      gdk_device_get_axis (ev->device, coords[i]->axes,
+				   GDK_AXIS_PRESSURE, &pressure);
+	      gdk_device_get_axis(ev->device, coords[i]->axes,
+				  GDK_AXIS_X, &x);
+	      gdk_device_get_axis(ev->device, coords[i]->axes,
+				  GDK_AXIS_Y, &y);
+
+	      history_point (data, devdata, x, y, pressure, coords[i]->time);
+	    }
+
+	  devdata->motion_time = coords[nevents-1]->time;
+	  points += nevents;
+	  g_free (coords);
+	}
     }
 
   /* always paint to the current event coordinate. */
@@ -363,36 +522,32 @@ gboolean on_motion (GtkWidget *win,
 
   if (pressure > 0)
     {
-      data->maxwidth = (CLAMP (pressure + line_thickener, 0, 1) *
+      devdata->maxwidth = (CLAMP (pressure + line_thickener, 0, 1) *
 			(double) (devdata->cur_context->width -
 				  devdata->cur_context->minwidth) +
 			devdata->cur_context->minwidth);
 
-      if(data->maxwidth > devdata->cur_context->maxwidth)
-        data->maxwidth = devdata->cur_context->maxwidth;
+      if(devdata->maxwidth > devdata->cur_context->maxwidth)
+        devdata->maxwidth = devdata->cur_context->maxwidth;
 
       if(devdata->motion_time > 0)
   	    {
+          latency_received (data, devdata, ev->time);
+
           switch (devdata->cur_context->type)
           {
           case GROMIT_ELLIPSE:
-            draw_shape_during_motion (ev, devdata, data, draw_ellipse);
-            break;
-
           case GROMIT_RECTANGLE:
-            draw_shape_during_motion (ev, devdata, data, draw_rectangle);
-            break;
-
           case GROMIT_LINE:
-            draw_shape_during_motion (ev, devdata, data, draw_line);
+            draw_shape_during_motion (ev, devdata, data);
             break;
 
           default:
-            draw_line (data, ev->device, devdata->lastx, devdata->lasty, ev->x, ev->y);
+            queue_line (data, ev->device, devdata->lastx, devdata->lasty, ev->x, ev->y);
             break;
           }
 
-	        coord_list_prepend (data, ev->device, ev->x, ev->y, data->maxwidth);
+	        coord_list_append (data, ev->device, ev->x, ev->y, devdata->maxwidth, ev->time);
 	      }
     }
 
@@ -400,7 +555,16 @@ gboolean on_motion (GtkWidget *win,
   devdata->lasty = ev->y;
   devdata->motion_time = ev->time;
 
-  draw_arrow_when_applicable(ev->device, devdata, data, GROMIT_ARROW_AT_START);
+  /* shapes get their arrows once they are committed */
+  if (!devdata->has_preview)
+    {
+      draw_arrow_when_applicable(ev->device, devdata, data, GROMIT_ARROW_AT_START);
+      prediction_draw(data, devdata);
+    }
+
+  trace_record_event (data, devdata, GROMIT_TRACE_MOTION, (GdkEvent *) ev);
+
+  GROMIT_PROFILE_END (data, "on_motion", ev->device, points);
 
   return TRUE;
 }
@@ -421,16 +585,139 @@ gboolean on_buttonrelease (GtkWidget *win,
   if (!devdata->is_grabbed)
     return FALSE;
 
+  data->counters.events++;
+
+  trace_record_event (data, devdata, GROMIT_TRACE_RELEASE, (GdkEvent *) ev);
+
+  /* the stroke must be complete before it is committed to the journal */
+  prediction_end (data, devdata);
+  queue_finish (data, devdata);
+  flush_all_pending (data);
+
+  if (devdata->has_preview)
+    {
+      preview_commit (data, ev->device);
+      draw_arrow_when_applicable(ev->device, devdata, data, GROMIT_ARROW_AT_START);
+    }
+
   draw_arrow_when_applicable(ev->device, devdata, data, GROMIT_ARROW_AT_END);
 
-  cleanup_context(devdata->cur_context);
+  cleanup_context(devdata);
 
-  coord_list_free (data, ev->device);
+  coord_list_clear (data, ev->device);
+
+  journal_end_stroke (data, devdata);
+  latency_end_stroke (data, devdata);
 
   return TRUE;
 }
 
+/*
+  Paint everything queued since the last frame. Runs once per frame of
+  the window's frame clock for as long as there is something queued.
+*/
+gboolean on_frame_tick (GtkWidget *widget,
+			GdkFrameClock *clock,
+			gpointer user_data)
+{
+  GromitData *data = (GromitData *) user_data;
+  gint64 start;
+  guint n;
+
+  /* keep the input thread's ring from filling up during long strokes */
+  collect_samples (data);
+
+  GROMIT_PROFILE_BEGIN (data, "on_frame_tick");
+  start = g_get_monotonic_time ();
+  n = flush_all_pending (data);
+  GROMIT_PROFILE_END (data, "on_frame_tick", NULL, n);
+
+  if (n == 0)
+    {
+      data->tick_id = 0;
+      return G_SOURCE_REMOVE;
+    }
+
+  render_cost_update (data, clock, g_get_monotonic_time () - start);
+
+  /* frame rate is counted only while someone reads it */
+  if (data->log_levels[GROMIT_LOG_DRAW] >= GROMIT_LOG_DEBUG)
+    {
+      gint64 now = gdk_frame_clock_get_frame_time (clock);
+
+      if (data->frame_stats_start == 0)
+	data->frame_stats_start = now;
+
+      data->frame_count++;
+      data->frame_segments += n;
+
+      if (now - data->frame_stats_start >= G_USEC_PER_SEC)
+	{
+	  GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "%.1f fps, %.1f segments per frame",
+			data->frame_count * (gdouble) G_USEC_PER_SEC / (now - data->frame_stats_start),
+			data->frame_segments / (gdouble) data->frame_count);
+	  data->frame_stats_start = now;
+	  data->frame_count = 0;
+	  data->frame_segments = 0;
+	}
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void window_damage (GromitData *data, const GdkRectangle *rect)
+{
+  data->counters.invalidated_pixels += (guint64) rect->width * rect->height;
+  gdk_window_invalidate_rect (gtk_widget_get_window (data->win), rect, 0);
+}
+
+
+static void window_schedule (GromitData *data)
+{
+  if (!data->tick_id)
+    data->tick_id = gtk_widget_add_tick_callback (data->win, on_frame_tick, data, NULL);
+}
+
+
+static void window_shape (GromitData *data, cairo_region_t *region)
+{
+  gtk_widget_shape_combine_region (data->win, region);
+}
+
+
+const GromitDrawingOps window_drawing_ops = {
+  window_damage,
+  window_schedule,
+  window_shape
+};
+
 /* Remote control */
+
+/* The counters as "name value" lines. */
+static gchar *stats_format (GromitData *data)
+{
+  GromitCounters *counters = &data->counters;
+  gsize surface_bytes = tiled_surface_get_populated_bytes (data->backbuffer)
+    + tiled_surface_get_populated_bytes (data->preview);
+
+  return g_strdup_printf ("events %" G_GUINT64_FORMAT "\n"
+			  "segments %" G_GUINT64_FORMAT "\n"
+			  "invalidated_pixels %" G_GUINT64_FORMAT "\n"
+			  "reshapes %" G_GUINT64_FORMAT "\n"
+			  "reshape_time_us %" G_GINT64_FORMAT "\n"
+			  "undo_bytes %" G_GSIZE_FORMAT "\n"
+			  "surface_bytes %" G_GSIZE_FORMAT "\n",
+			  counters->events,
+			  counters->segments,
+			  counters->invalidated_pixels,
+			  counters->reshapes,
+			  counters->reshape_time,
+			  journal_get_bytes (data),
+			  surface_bytes);
+}
+
+
 void on_mainapp_selection_get (GtkWidget          *widget,
 			       GtkSelectionData   *selection_data,
 			       guint               info,
@@ -440,6 +727,7 @@ void on_mainapp_selection_get (GtkWidget          *widget,
   GromitData *data = (GromitData *) user_data;
 
   gchar *uri = "OK";
+  gchar *stats = NULL;
   GdkAtom action = gtk_selection_data_get_target(selection_data);
 
   if(action == GA_TOGGLE)
@@ -473,6 +761,8 @@ void on_mainapp_selection_get (GtkWidget          *widget,
     undo_drawing (data);
   else if (action == GA_REDO)
     redo_drawing (data);
+  else if (action == GA_STATS)
+    uri = stats = stats_format (data);
   else
     uri = "NOK";
 
@@ -480,6 +770,7 @@ void on_mainapp_selection_get (GtkWidget          *widget,
   gtk_selection_data_set (selection_data,
                           gtk_selection_data_get_target(selection_data),
                           8, (guchar*)uri, strlen (uri));
+  g_free (stats);
 }
 
 void on_mainapp_selection_received(GtkWidget *widget,
@@ -492,8 +783,7 @@ void on_mainapp_selection_received(GtkWidget *widget,
 
   if (gtk_selection_data_get_length(selection_data) < 0)
   {
-    if (data->debug)
-      g_printerr("DEBUG: mainapp got no answer back from client.\n");
+    GROMIT_DEBUG (data, GROMIT_LOG_IPC, "mainapp got no answer back from client.");
   }
   else
   {
@@ -502,8 +792,7 @@ void on_mainapp_selection_received(GtkWidget *widget,
     {
       intptr_t dev_nr = strtoull((gchar *)gtk_selection_data_get_data(selection_data), NULL, 10);
 
-      if (data->debug)
-        g_printerr("DEBUG: mainapp got toggle id '%ld' back from client.\n", (long)dev_nr);
+      GROMIT_DEBUG (data, GROMIT_LOG_IPC, "mainapp got toggle id '%ld' back from client.", (long)dev_nr);
 
       if (dev_nr < 0) /* toggle all */
         if (action == GA_TOGGLEDATA)
@@ -554,8 +843,7 @@ void on_device_removed (GdkDeviceManager *device_manager,
      || gdk_device_get_n_axes(device) < 2)
     return;
 
-  if(data->debug)
-    g_printerr("DEBUG: device '%s' removed\n", gdk_device_get_name(device));
+  GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "device '%s' removed", gdk_device_get_name(device));
 
   setup_input_devices(data);
 }
@@ -570,8 +858,7 @@ void on_device_added (GdkDeviceManager *device_manager,
      || gdk_device_get_n_axes(device) < 2)
     return;
 
-  if(data->debug)
-    g_printerr("DEBUG: device '%s' added\n", gdk_device_get_name(device));
+  GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "device '%s' added", gdk_device_get_name(device));
 
   setup_input_devices(data);
 }
@@ -584,8 +871,7 @@ gboolean on_toggle_paint(GtkWidget *widget,
 {
     GromitData *data = (GromitData *) user_data;
 
-    if(data->debug)
-	g_printerr("DEBUG: Device '%s': Button %i on_toggle_paint at (x,y)=(%.2f : %.2f)\n",
+    GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "Device '%s': Button %i on_toggle_paint at (x,y)=(%.2f : %.2f)",
 		   gdk_device_get_name(ev->device), ev->button, ev->x, ev->y);
 
     toggle_grab(data, ev->device);
@@ -28,6 +28,8 @@
 #include <gdk/gdk.h>
 #include <gtk/gtk.h>
 
+#include "main.h"
+
 
 gboolean on_expose (GtkWidget *widget,
 		    cairo_t* cr,
@@ -65,6 +67,11 @@ gboolean on_motion (GtkWidget *win, GdkEventMotion *ev, gpointer user_data);
 
 gboolean on_buttonrelease (GtkWidget *win, GdkEventButton *ev, gpointer user_data);
 
+gboolean on_frame_tick (GtkWidget *widget, GdkFrameClock *clock, gpointer user_data);
+
+/* Draws to the window, painting queued strokes on its frame clock. */
+extern const GromitDrawingOps window_drawing_ops;
+
 void on_mainapp_selection_get (GtkWidget          *widget,
 			       GtkSelectionData   *selection_data,
 			       guint               info,
@@ -141,7 +141,7 @@ gboolean parse_config (GromitData *data)
 
   GromitPaintType type;
   GdkRGBA *fg_color=NULL;
-  guint width, arrowsize, minwidth, maxwidth;
+  guint width, arrowsize, minwidth, maxwidth, smooth, predict;
   GromitArrowPosition arrowposition;
 
   /* try user config location */
@@ -211,6 +211,8 @@ gboolean parse_config (GromitData *data)
   g_scanner_scope_add_symbol (scanner, 2, "minsize",      (gpointer) 4);
   g_scanner_scope_add_symbol (scanner, 2, "maxsize",      (gpointer) 5);
   g_scanner_scope_add_symbol (scanner, 2, "arrowposition",(gpointer) 6);
+  g_scanner_scope_add_symbol (scanner, 2, "smooth",       (gpointer) 7);
+  g_scanner_scope_add_symbol (scanner, 2, "predict",      (gpointer) 8);
 
   g_scanner_set_scope (scanner, 0);
   scanner->config->scope_0_fallback = 0;
@@ -249,6 +251,8 @@ gboolean parse_config (GromitData *data)
           arrowposition = GROMIT_ARROW_AT_END;
           minwidth = 1;
           maxwidth = G_MAXUINT;
+          smooth = 0;
+          predict = 0;
           fg_color = data->red;
 
           if (token == G_TOKEN_SYMBOL)
@@ -271,6 +275,8 @@ gboolean parse_config (GromitData *data)
                   arrowposition = context_template->arrowposition;
                   minwidth = context_template->minwidth;
 		              maxwidth = context_template->maxwidth;
+                  smooth = context_template->smooth;
+                  predict = context_template->predict;
                   fg_color = context_template->paint_color;
                 }
               else
@@ -418,6 +424,40 @@ gboolean parse_config (GromitData *data)
                               goto cleanup;
                             }
                         }
+                      else if ((intptr_t) scanner->value.v_symbol == 7)
+                        {
+                          token = g_scanner_get_next_token (scanner);
+                          if (token != G_TOKEN_EQUAL_SIGN)
+                            {
+                              g_printerr ("Missing \"=\"... aborting\n");
+                              goto cleanup;
+                            }
+                          token = g_scanner_get_next_token (scanner);
+                          if (token != G_TOKEN_FLOAT)
+                            {
+                              g_printerr ("Missing Smooth (float)... "
+                                          "aborting\n");
+                              goto cleanup;
+                            }
+                          smooth = scanner->value.v_float;
+                        }
+                      else if ((intptr_t) scanner->value.v_symbol == 8)
+                        {
+                          token = g_scanner_get_next_token (scanner);
+                          if (token != G_TOKEN_EQUAL_SIGN)
+                            {
+                              g_printerr ("Missing \"=\"... aborting\n");
+                              goto cleanup;
+                            }
+                          token = g_scanner_get_next_token (scanner);
+                          if (token != G_TOKEN_FLOAT)
+                            {
+                              g_printerr ("Missing Predict (float)... "
+                                          "aborting\n");
+                              goto cleanup;
+                            }
+                          predict = scanner->value.v_float;
+                        }
 		      else
                         {
                           g_printerr ("Unknown tool type?????\n");
@@ -443,7 +483,7 @@ gboolean parse_config (GromitData *data)
               goto cleanup;
             }
 
-          context = paint_context_new (data, type, fg_color, width, arrowsize, arrowposition, minwidth, maxwidth);
+          context = paint_context_new (data, type, fg_color, width, arrowsize, arrowposition, minwidth, maxwidth, smooth, predict);
 
           g_hash_table_insert (data->tool_config, name, context);
         }
@@ -504,6 +544,9 @@ gboolean parse_config (GromitData *data)
 
  cleanup:
 
+  /* tools resolved from the old config are stale now */
+  data->tool_generation++;
+
   if (!status) {
       /* purge incomplete tool config */
       GHashTableIter it;
@@ -551,6 +594,20 @@ int parse_args (int argc, char **argv, GromitData *data)
                 strcmp (arg, "--debug") == 0)
          {
            data->debug = 1;
+           log_set_all (data->log_levels, GROMIT_LOG_DEBUG);
+         }
+       else if (strcmp (arg, "--log") == 0)
+         {
+           if (i+1 < argc)
+             {
+               wrong_arg = !log_parse (data->log_levels, argv[i+1]);
+               i++;
+             }
+           else
+             {
+               g_printerr ("--log requires a list of categories as argument\n");
+               wrong_arg = TRUE;
+             }
          }
        else if (strcmp (arg, "-k") == 0 ||
                 strcmp (arg, "--key") == 0)
@@ -628,6 +685,47 @@ int parse_args (int argc, char **argv, GromitData *data)
                wrong_arg = TRUE;
              }
          }
+       else if (strcmp (arg, "--record") == 0)
+         {
+           if (i+1 < argc)
+             {
+               data->record_file = argv[i+1];
+               i++;
+             }
+           else
+             {
+               g_printerr ("--record requires a file name as argument\n");
+               wrong_arg = TRUE;
+             }
+         }
+       else if (strcmp (arg, "--replay") == 0 ||
+                strcmp (arg, "--replay-fast") == 0)
+         {
+           if (i+1 < argc)
+             {
+               data->replay_file = argv[i+1];
+               data->replay_fast = strcmp (arg, "--replay-fast") == 0;
+               i++;
+             }
+           else
+             {
+               g_printerr ("%s requires a file name as argument\n", arg);
+               wrong_arg = TRUE;
+             }
+         }
+       else if (strcmp (arg, "--profile") == 0)
+         {
+           if (i+1 < argc)
+             {
+               data->profile_file = argv[i+1];
+               i++;
+             }
+           else
+             {
+               g_printerr ("--profile requires a file name as argument\n");
+               wrong_arg = TRUE;
+             }
+         }
        else if (strcmp (arg, "-V") == 0 ||
 		strcmp (arg, "--version") == 0)
          {
@@ -1,6 +1,328 @@
 
 #include <math.h>
 #include "drawing.h"
+#include "shape.h"
+#include "tiles.h"
+#include "journal.h"
+#include "smooth.h"
+#include "predict.h"
+#include "latency.h"
+#include "profile.h"
+
+/*
+  Report an area of the backbuffer that was drawn to: it gets redrawn on
+  screen, rescanned for the window shape and its tiles are kept.
+  While a frame's worth of segments is painted, invalidation is collected
+  in data->frame_damage instead.
+*/
+void damage_backbuffer (GromitData *data, const GdkRectangle *rect)
+{
+  /* antialiasing may bleed a pixel over the computed bounds */
+  GdkRectangle padded = {rect->x - 1, rect->y - 1, rect->width + 2, rect->height + 2};
+
+  if (data->frame_damage)
+    cairo_region_union_rectangle(data->frame_damage, &padded);
+  else
+    data->drawing_ops->damage(data, &padded);
+  shape_damage(data, &padded);
+  tiled_surface_mark(data->backbuffer, &padded);
+}
+
+/*
+  Set up the device's cairo context for drawing with its current tool on
+  the current backbuffer. Each device has its own, so that devices
+  drawing at the same time do not change each other's cairo state.
+*/
+void device_paint_ctx_update (GromitData *data,
+			      GromitDeviceData *devdata)
+{
+  GromitPaintContext *context = devdata->cur_context;
+
+  if (devdata->paint_ctx && cairo_get_target (devdata->paint_ctx) != data->backbuffer)
+    {
+      cairo_destroy(devdata->paint_ctx);
+      devdata->paint_ctx = NULL;
+    }
+
+  if (!devdata->paint_ctx)
+    devdata->paint_ctx = cairo_create (data->backbuffer);
+
+  if (!context)
+    return;
+
+  gdk_cairo_set_source_rgba(devdata->paint_ctx, data->switch_color ? data->switch_color : context->paint_color);
+  cairo_set_antialias(devdata->paint_ctx, data->composited ? CAIRO_ANTIALIAS_DEFAULT : CAIRO_ANTIALIAS_NONE);
+  cairo_set_line_width(devdata->paint_ctx, context->width);
+  cairo_set_line_cap(devdata->paint_ctx, CAIRO_LINE_CAP_ROUND);
+  cairo_set_line_join(devdata->paint_ctx, CAIRO_LINE_JOIN_ROUND);
+
+  if (context->type == GROMIT_ERASER)
+    cairo_set_operator(devdata->paint_ctx, CAIRO_OPERATOR_CLEAR);
+  else
+    if (context->type == GROMIT_RECOLOR)
+      cairo_set_operator(devdata->paint_ctx, CAIRO_OPERATOR_ATOP);
+    else
+      cairo_set_operator(devdata->paint_ctx, CAIRO_OPERATOR_OVER);
+}
+
+
+/*
+  Point all devices' cairo contexts at data->backbuffer again after it
+  was replaced by another surface.
+*/
+void paint_contexts_retarget (GromitData *data)
+{
+  GHashTableIter it;
+  gpointer value;
+
+  g_hash_table_iter_init (&it, data->devdatatable);
+  while (g_hash_table_iter_next (&it, NULL, &value))
+    if (((GromitDeviceData *) value)->paint_ctx)
+      device_paint_ctx_update (data, value);
+}
+
+
+/*
+  The paint_* functions do the actual painting onto a cairo context with
+  its source and operator already set up, returning the touched area in
+  bounds. They are shared by the draw_* functions below and journal replay.
+*/
+void paint_line (cairo_t *cr,
+		 gint x1, gint y1,
+		 gint x2, gint y2,
+		 guint width,
+		 GdkRectangle *bounds)
+{
+  bounds->x = MIN (x1,x2) - width / 2;
+  bounds->y = MIN (y1,y2) - width / 2;
+  bounds->width = ABS (x1-x2) + width;
+  bounds->height = ABS (y1-y2) + width;
+
+  cairo_set_line_width(cr, width);
+  cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+  cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+
+  cairo_move_to(cr, x1, y1);
+  cairo_line_to(cr, x2, y2);
+  cairo_stroke(cr);
+}
+
+void paint_ellipse (cairo_t *cr,
+		    gint x1, gint y1,
+		    gint x2, gint y2,
+		    guint width,
+		    GdkRectangle *bounds)
+{
+  bounds->x = MIN (x1,x2) - width / 2;
+  bounds->y = MIN (y1,y2) - width / 2;
+  bounds->width = ABS (x1-x2) + width;
+  bounds->height = ABS (y1-y2) + width;
+
+  cairo_save(cr);
+  cairo_translate(cr, bounds->x + (bounds->width / 2.0), bounds->y + (bounds->height / 2.0));
+  cairo_scale(cr, bounds->width / 2.0, bounds->height / 2.0);
+  cairo_arc(cr, 0.0, 0.0, 1.0, 0.0, M_PI * 2);
+  cairo_restore(cr);
+
+  cairo_set_line_width(cr, width);
+  cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+  cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+
+  cairo_stroke(cr);
+}
+
+void paint_rectangle (cairo_t *cr,
+		      gint x1, gint y1,
+		      gint x2, gint y2,
+		      guint width,
+		      GdkRectangle *bounds)
+{
+  bounds->x = MIN (x1,x2) - width / 2;
+  bounds->y = MIN (y1,y2) - width / 2;
+  bounds->width = ABS (x1-x2) + width;
+  bounds->height = ABS (y1-y2) + width;
+
+  cairo_rectangle(cr, bounds->x, bounds->y, bounds->width, bounds->height);
+
+  cairo_set_line_width(cr, width);
+  cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+  cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+
+  cairo_stroke(cr);
+}
+
+void paint_arrow (cairo_t *cr,
+		  gint x1, gint y1,
+		  gint width,
+		  gfloat direction,
+		  guint linewidth,
+		  const GdkRGBA *color,
+		  const GdkRGBA *outline,
+		  GdkRectangle *bounds)
+{
+  GdkPoint arrowhead[4];
+
+  width = width / 2;
+
+  int origin_factor = 4;
+  int back_factor = 2;
+  int side_factor = 3;
+
+  int origin_x = x1 - origin_factor * width * cos(direction);
+  int origin_y = y1 - origin_factor * width * sin(direction);
+
+  /* I doubt that calculating the boundary box more exact is very useful */
+  bounds->x = origin_x - 4 * width - 1;
+  bounds->y = origin_y - 4 * width - 1;
+  bounds->width = 8 * width + 2;
+  bounds->height = 8 * width + 2;
+
+  arrowhead[0].x = origin_x + origin_factor * width * cos(direction);
+  arrowhead[0].y = origin_y + origin_factor * width * sin(direction);
+
+  arrowhead[1].x = origin_x - side_factor * width * cos(direction)
+                            + side_factor * width * sin(direction);
+  arrowhead[1].y = origin_y - side_factor * width * cos(direction)
+                            - side_factor * width * sin(direction);
+
+  arrowhead[2].x = origin_x - back_factor * width * cos(direction);
+  arrowhead[2].y = origin_y - back_factor * width * sin(direction);
+
+  arrowhead[3].x = origin_x - side_factor * width * cos(direction)
+                            - side_factor * width * sin(direction);
+  arrowhead[3].y = origin_y + side_factor * width * cos(direction)
+                            - side_factor * width * sin(direction);
+
+  cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+  cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+
+  //Erase the beginning of the line in order to keep only the arrow point
+  cairo_set_line_width(cr, linewidth + 1);
+  cairo_operator_t previous_operator = cairo_get_operator(cr);
+  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+  cairo_move_to(cr, x1, y1);
+  cairo_line_to(cr, origin_x, origin_y);
+  cairo_stroke(cr);
+  cairo_set_operator(cr, previous_operator);
+
+  cairo_set_line_width(cr, 1);
+
+  gdk_cairo_set_source_rgba(cr, color);
+
+  cairo_move_to(cr, arrowhead[0].x, arrowhead[0].y);
+  cairo_line_to(cr, arrowhead[1].x, arrowhead[1].y);
+  cairo_line_to(cr, arrowhead[2].x, arrowhead[2].y);
+  cairo_line_to(cr, arrowhead[3].x, arrowhead[3].y);
+  cairo_fill(cr);
+
+  gdk_cairo_set_source_rgba(cr, outline);
+
+  cairo_move_to(cr, arrowhead[0].x, arrowhead[0].y);
+  cairo_line_to(cr, arrowhead[1].x, arrowhead[1].y);
+  cairo_line_to(cr, arrowhead[2].x, arrowhead[2].y);
+  cairo_line_to(cr, arrowhead[3].x, arrowhead[3].y);
+  cairo_line_to(cr, arrowhead[0].x, arrowhead[0].y);
+  cairo_stroke(cr);
+
+  gdk_cairo_set_source_rgba(cr, color);
+}
+
+/* Whether segment i starts where the one before it ended. */
+static gboolean segment_continues (const GromitSegment *segments, guint i)
+{
+  return i > 0 && segments[i].x1 == segments[i - 1].x2 && segments[i].y1 == segments[i - 1].y2;
+}
+
+
+void segment_bounds (const GromitSegment *segments, guint i, GdkRectangle *bounds)
+{
+  guint width = segments[i].width;
+
+  bounds->x = MIN (segments[i].x1, segments[i].x2) - width / 2;
+  bounds->y = MIN (segments[i].y1, segments[i].y2) - width / 2;
+  bounds->width = ABS (segments[i].x1 - segments[i].x2) + width;
+  bounds->height = ABS (segments[i].y1 - segments[i].y2) + width;
+}
+
+
+/* Add a full circle, wound the same way as add_hull() winds its quads. */
+static void add_disc (cairo_t *cr, gdouble x, gdouble y, gdouble r)
+{
+  if (r <= 0)
+    return;
+  cairo_new_sub_path (cr);
+  cairo_arc (cr, x, y, r, 0, M_PI * 2);
+  cairo_close_path (cr);
+}
+
+
+/*
+  Add the hull between two discs: the quad spanned by their outer
+  tangents, wound the same way as the discs.
+*/
+static void add_hull (cairo_t *cr,
+		      gdouble x1, gdouble y1, gdouble r1,
+		      gdouble x2, gdouble y2, gdouble r2)
+{
+  gdouble dx = x2 - x1, dy = y2 - y1;
+  gdouble d = sqrt (dx * dx + dy * dy);
+  gdouble ux, uy, c, s;
+
+  /* one disc contains the other */
+  if (d <= fabs (r1 - r2))
+    return;
+
+  ux = dx / d;
+  uy = dy / d;
+  c = (r1 - r2) / d;
+  s = sqrt (1 - c * c);
+
+  /* tangent directions are u*c +- n*s, with n = (-uy, ux) */
+  cairo_new_sub_path (cr);
+  cairo_move_to (cr, x1 + r1 * (ux * c - uy * s), y1 + r1 * (uy * c + ux * s));
+  cairo_line_to (cr, x1 + r1 * (ux * c + uy * s), y1 + r1 * (uy * c - ux * s));
+  cairo_line_to (cr, x2 + r2 * (ux * c + uy * s), y2 + r2 * (uy * c - ux * s));
+  cairo_line_to (cr, x2 + r2 * (ux * c - uy * s), y2 + r2 * (uy * c + ux * s));
+  cairo_close_path (cr);
+}
+
+
+void paint_outline (cairo_t *cr,
+		    const GromitSegment *segments,
+		    guint n,
+		    GdkRectangle *bounds)
+{
+  guint i;
+
+  for (i = 0; i < n; i++)
+    {
+      gdouble r = segments[i].width / 2.0;
+      gdouble r1 = r;
+      GdkRectangle rect;
+
+      /*
+	 A segment going on from the one before starts at that one's end
+	 disc, and tapers from its width to its own.
+      */
+      if (segment_continues (segments, i))
+	r1 = segments[i - 1].width / 2.0;
+      else
+	add_disc (cr, segments[i].x1, segments[i].y1, r);
+      add_hull (cr, segments[i].x1, segments[i].y1, r1, segments[i].x2, segments[i].y2, r);
+      add_disc (cr, segments[i].x2, segments[i].y2, r);
+
+      segment_bounds (segments, i, &rect);
+      if (i == 0)
+	*bounds = rect;
+      else
+	gdk_rectangle_union (bounds, &rect, bounds);
+    }
+
+  /* all pieces are wound alike, so the nonzero rule fills their union once */
+  cairo_set_fill_rule (cr, CAIRO_FILL_RULE_WINDING);
+  cairo_fill (cr);
+}
+
 
 void draw_line (GromitData *data,
 		GdkDevice *dev,
@@ -10,33 +332,171 @@ void draw_line (GromitData *data,
   GdkRectangle rect;
   GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, dev);
 
-  rect.x = MIN (x1,x2) - data->maxwidth / 2;
-  rect.y = MIN (y1,y2) - data->maxwidth / 2;
-  rect.width = ABS (x1-x2) + data->maxwidth;
-  rect.height = ABS (y1-y2) + data->maxwidth;
-
-  if(data->debug)
-    g_printerr("DEBUG: draw line from %d %d to %d %d\n", x1, y1, x2, y2);
+  GROMIT_TRACE (data, GROMIT_LOG_DRAW, "draw line from %d %d to %d %d", x1, y1, x2, y2);
 
-  if (devdata->cur_context->paint_ctx)
+  if (devdata->paint_ctx)
     {
-      if(data->switch_color)
-        gdk_cairo_set_source_rgba(devdata->cur_context->paint_ctx, data->switch_color);
+      GromitJournalOp op = {GROMIT_OP_LINE, x1, y1, x2, y2, devdata->maxwidth, 0};
 
-      cairo_set_line_width(devdata->cur_context->paint_ctx, data->maxwidth);
-      cairo_set_line_cap(devdata->cur_context->paint_ctx, CAIRO_LINE_CAP_ROUND);
-      cairo_set_line_join(devdata->cur_context->paint_ctx, CAIRO_LINE_JOIN_ROUND);
+      GROMIT_PROFILE_BEGIN (data, "draw_line");
 
-      cairo_move_to(devdata->cur_context->paint_ctx, x1, y1);
-      cairo_line_to(devdata->cur_context->paint_ctx, x2, y2);
-      cairo_stroke(devdata->cur_context->paint_ctx);
+      paint_line(devdata->paint_ctx, x1, y1, x2, y2, devdata->maxwidth, &rect);
+      journal_add_op(devdata, &op, &rect);
 
       data->modified = 1;
 
-      gdk_window_invalidate_rect(gtk_widget_get_window(data->win), &rect, 0);
+      damage_backbuffer(data, &rect);
+      latency_rasterized(data, devdata);
+
+      GROMIT_PROFILE_END (data, "draw_line", dev, 2);
+    }
+
+  data->painted = 1;
+}
+
+void queue_line (GromitData *data,
+		 GdkDevice *dev,
+		 gint x1, gint y1,
+		 gint x2, gint y2)
+{
+  GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, dev);
+  GromitSegment segment = {x1, y1, x2, y2, devdata->maxwidth};
+  guint smooth = devdata->cur_context->smooth;
+
+  if (!devdata->pending)
+    devdata->pending = g_array_new (FALSE, FALSE, sizeof (GromitSegment));
+
+  devdata->stroke_points++;
+
+  if (smooth > 0)
+    {
+      if (!devdata->smoother)
+	devdata->smoother = smoother_new ();
+
+      if (!smoother_is_active (devdata->smoother))
+	{
+	  smoother_begin (devdata->smoother, x1, y1, devdata->maxwidth, smooth);
+	  /* a click still leaves a dot */
+	  if (x1 == x2 && y1 == y2)
+	    g_array_append_val (devdata->pending, segment);
+	}
+
+      smoother_add (devdata->smoother, x2, y2, devdata->maxwidth, devdata->pending);
+    }
+  else
+    g_array_append_val (devdata->pending, segment);
+
+  data->drawing_ops->schedule (data);
+}
+
+/*
+  Queue what is left of the device's stroke. Must come before the last
+  flush of a stroke.
+*/
+void queue_finish (GromitData *data, GromitDeviceData *devdata)
+{
+  if (devdata->smoother && smoother_is_active (devdata->smoother))
+    smoother_end (devdata->smoother, devdata->pending);
+
+  if (devdata->stroke_points > 0)
+    GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "Stroke of %u input points: %u segments, %.2f ms painting so far.",
+		  devdata->stroke_points, devdata->stroke_segments,
+		  devdata->stroke_paint_time / 1000.0);
+
+  devdata->stroke_points = 0;
+  devdata->stroke_segments = 0;
+  devdata->stroke_paint_time = 0;
+}
+
+
+void flush_pending (GromitData *data, GromitDeviceData *devdata)
+{
+  if (!devdata->pending || devdata->pending->len == 0)
+    return;
+
+  draw_segments (data, devdata, (GromitSegment *) devdata->pending->data, devdata->pending->len);
+  g_array_set_size (devdata->pending, 0);
+}
+
+
+/*
+  Paint a frame's worth of segments as a single filled outline, so the
+  joints are not painted over twice and translucent ink stays even.
+*/
+void draw_segments (GromitData *data,
+		    GromitDeviceData *devdata,
+		    const GromitSegment *segments,
+		    guint n)
+{
+  GdkRectangle rect;
+  guint i;
+  gint64 t0 = g_get_monotonic_time ();
+
+  if (!devdata->paint_ctx || n == 0)
+    return;
+
+  GROMIT_PROFILE_BEGIN (data, "draw_segments");
+
+  GROMIT_TRACE (data, GROMIT_LOG_DRAW, "draw outline of %u segments", n);
+
+  paint_outline(devdata->paint_ctx, segments, n, &rect);
+
+  /* damage what was painted, not the bounding box of a long diagonal */
+  for (i = 0; i < n; i++)
+    {
+      GromitJournalOp op = {GROMIT_OP_LINE, segments[i].x1, segments[i].y1,
+			    segments[i].x2, segments[i].y2, segments[i].width, 0};
+      segment_bounds (segments, i, &rect);
+      journal_add_op(devdata, &op, &rect);
+      damage_backbuffer(data, &rect);
     }
 
+  devdata->stroke_segments += n;
+  data->counters.segments += n;
+  devdata->stroke_paint_time += g_get_monotonic_time () - t0;
+  latency_rasterized (data, devdata);
+
+  data->modified = 1;
   data->painted = 1;
+
+  GROMIT_PROFILE_END (data, "draw_segments", devdata->device, n);
+}
+
+
+/*
+  Paint the queued segments of all devices, invalidating the union of
+  what they touched once. Returns the number of segments painted.
+*/
+guint flush_all_pending (GromitData *data)
+{
+  GHashTableIter it;
+  gpointer value;
+  guint n = 0;
+  gint i;
+
+  data->frame_damage = cairo_region_create();
+
+  g_hash_table_iter_init (&it, data->devdatatable);
+  while (g_hash_table_iter_next (&it, NULL, &value))
+    {
+      GromitDeviceData *devdata = value;
+      if (devdata->pending)
+	{
+	  n += devdata->pending->len;
+	  flush_pending (data, devdata);
+	}
+    }
+
+  for (i = 0; i < cairo_region_num_rectangles(data->frame_damage); i++)
+    {
+      cairo_rectangle_int_t rect;
+      cairo_region_get_rectangle(data->frame_damage, i, &rect);
+      data->drawing_ops->damage(data, &rect);
+    }
+  cairo_region_destroy(data->frame_damage);
+  data->frame_damage = NULL;
+
+  return n;
 }
 
 void draw_arrow_when_applicable(GdkDevice *device, GromitDeviceData *devdata, GromitData *data, GromitArrowPosition position)
@@ -60,17 +520,20 @@ void draw_arrow_when_applicable(GdkDevice *device, GromitDeviceData *devdata, Gr
   switch (position)
   {
   case GROMIT_ARROW_AT_START:
-    if(devdata->cur_context->start_arrow_painted &&
+    if(devdata->start_arrow_painted &&
       devdata->cur_context->type == GROMIT_PEN)
       return;
 
-    arrow_point = g_list_last(devdata->coordlist)->data;
+    /* the arrow goes on top of the line it points along */
+    flush_pending (data, devdata);
+    arrow_point = coord_list_first(devdata);
     draw_arrow (data, device, arrow_point->x, arrow_point->y, width, direction);
-    devdata->cur_context->start_arrow_painted = TRUE;
+    devdata->start_arrow_painted = TRUE;
 
     break;
   case GROMIT_ARROW_AT_END:
-    arrow_point = devdata->coordlist->data;
+    flush_pending (data, devdata);
+    arrow_point = coord_list_last(devdata);
     draw_arrow (data, device, arrow_point->x, arrow_point->y, width, direction);
 
     break;
@@ -89,34 +552,23 @@ void draw_ellipse(GromitData *data,
   GdkRectangle rect;
   GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, dev);
 
-  rect.x = MIN (x1,x2) - data->maxwidth / 2;
-  rect.y = MIN (y1,y2) - data->maxwidth / 2;
-  rect.width = ABS (x1-x2) + data->maxwidth;
-  rect.height = ABS (y1-y2) + data->maxwidth;
-
-  if(data->debug)
-    g_printerr("DEBUG: draw ellipse coord (%d,%d) %dx%d\n", rect.x, rect.y, rect.width, rect.height);
-
-  if (devdata->cur_context->paint_ctx)
+  if (devdata->paint_ctx)
     {
-      if(data->switch_color)
-        gdk_cairo_set_source_rgba(devdata->cur_context->paint_ctx, data->switch_color);
+      GromitJournalOp op = {GROMIT_OP_ELLIPSE, x1, y1, x2, y2, devdata->maxwidth, 0};
+
+      GROMIT_PROFILE_BEGIN (data, "draw_ellipse");
 
-      cairo_save(devdata->cur_context->paint_ctx);
-      cairo_translate(devdata->cur_context->paint_ctx, rect.x + (rect.width / 2.0), rect.y + (rect.height / 2.0));
-      cairo_scale(devdata->cur_context->paint_ctx, rect.width / 2.0, rect.height / 2.0);
-      cairo_arc(devdata->cur_context->paint_ctx, 0.0, 0.0, 1.0, 0.0, M_PI * 2);
-      cairo_restore(devdata->cur_context->paint_ctx);
+      paint_ellipse(devdata->paint_ctx, x1, y1, x2, y2, devdata->maxwidth, &rect);
 
-      cairo_set_line_width(devdata->cur_context->paint_ctx, data->maxwidth);
-      cairo_set_line_cap(devdata->cur_context->paint_ctx, CAIRO_LINE_CAP_ROUND);
-      cairo_set_line_join(devdata->cur_context->paint_ctx, CAIRO_LINE_JOIN_ROUND);
+      GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "draw ellipse coord (%d,%d) %dx%d", rect.x, rect.y, rect.width, rect.height);
 
-      cairo_stroke(devdata->cur_context->paint_ctx);
+      journal_add_op(devdata, &op, &rect);
 
       data->modified = 1;
 
-      gdk_window_invalidate_rect(gtk_widget_get_window(data->win), &rect, 0);
+      damage_backbuffer(data, &rect);
+
+      GROMIT_PROFILE_END (data, "draw_ellipse", dev, 2);
     }
 
   data->painted = 1;
@@ -130,30 +582,23 @@ void draw_rectangle(GromitData *data,
   GdkRectangle rect;
   GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, dev);
 
-  rect.x = MIN (x1,x2) - data->maxwidth / 2;
-  rect.y = MIN (y1,y2) - data->maxwidth / 2;
-  rect.width = ABS (x1-x2) + data->maxwidth;
-  rect.height = ABS (y1-y2) + data->maxwidth;
-
-  if(data->debug)
-    g_printerr("DEBUG: draw rectangle coord (%d,%d) %dx%d\n", rect.x, rect.y, rect.width, rect.height);
-
-  if (devdata->cur_context->paint_ctx)
+  if (devdata->paint_ctx)
     {
-      if(data->switch_color)
-        gdk_cairo_set_source_rgba(devdata->cur_context->paint_ctx, data->switch_color);
+      GromitJournalOp op = {GROMIT_OP_RECTANGLE, x1, y1, x2, y2, devdata->maxwidth, 0};
+
+      GROMIT_PROFILE_BEGIN (data, "draw_rectangle");
 
-      cairo_rectangle(devdata->cur_context->paint_ctx, rect.x, rect.y, rect.width, rect.height);
+      paint_rectangle(devdata->paint_ctx, x1, y1, x2, y2, devdata->maxwidth, &rect);
 
-      cairo_set_line_width(devdata->cur_context->paint_ctx, data->maxwidth);
-      cairo_set_line_cap(devdata->cur_context->paint_ctx, CAIRO_LINE_CAP_ROUND);
-      cairo_set_line_join(devdata->cur_context->paint_ctx, CAIRO_LINE_JOIN_ROUND);
+      GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "draw rectangle coord (%d,%d) %dx%d", rect.x, rect.y, rect.width, rect.height);
 
-      cairo_stroke(devdata->cur_context->paint_ctx);
+      journal_add_op(devdata, &op, &rect);
 
       data->modified = 1;
 
-      gdk_window_invalidate_rect(gtk_widget_get_window(data->win), &rect, 0);
+      damage_backbuffer(data, &rect);
+
+      GROMIT_PROFILE_END (data, "draw_rectangle", dev, 2);
     }
 
   data->painted = 1;
@@ -166,148 +611,278 @@ void draw_arrow(GromitData *data,
                 gfloat direction)
 {
   GdkRectangle rect;
-  GdkPoint arrowhead[4];
 
   /* get the data for this device */
   GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, dev);
 
-  width = width / 2;
+  if (devdata->paint_ctx)
+  {
+    GromitJournalOp op = {GROMIT_OP_ARROW, x1, y1, width, 0, devdata->maxwidth, direction};
 
-  int origin_factor = 4;
-  int back_factor = 2;
-  int side_factor = 3;
+    GROMIT_PROFILE_BEGIN (data, "draw_arrow");
+    paint_arrow(devdata->paint_ctx, x1, y1, width, direction, devdata->maxwidth,
+		data->switch_color ? data->switch_color : devdata->cur_context->paint_color,
+		data->black, &rect);
+    journal_add_op(devdata, &op, &rect);
 
-  int origin_x = x1 - origin_factor * width * cos(direction);
-  int origin_y = y1 - origin_factor * width * sin(direction);
+    data->modified = 1;
 
-  /* I doubt that calculating the boundary box more exact is very useful */
-  rect.x = origin_x - 4 * width - 1;
-  rect.y = origin_y - 4 * width - 1;
-  rect.width = 8 * width + 2;
-  rect.height = 8 * width + 2;
+    damage_backbuffer(data, &rect);
 
-  arrowhead[0].x = origin_x + origin_factor * width * cos(direction);
-  arrowhead[0].y = origin_y + origin_factor * width * sin(direction);
+    GROMIT_PROFILE_END (data, "draw_arrow", dev, 1);
+  }
 
-  arrowhead[1].x = origin_x - side_factor * width * cos(direction)
-                            + side_factor * width * sin(direction);
-  arrowhead[1].y = origin_y - side_factor * width * cos(direction)
-                            - side_factor * width * sin(direction);
+  data->painted = 1;
+}
 
-  arrowhead[2].x = origin_x - back_factor * width * cos(direction);
-  arrowhead[2].y = origin_y - back_factor * width * sin(direction);
 
-  arrowhead[3].x = origin_x - side_factor * width * cos(direction)
-                            - side_factor * width * sin(direction);
-  arrowhead[3].y = origin_y + side_factor * width * cos(direction)
-                            - side_factor * width * sin(direction);
+void coord_list_append (GromitData *data,
+			GdkDevice* dev,
+			gint x,
+			gint y,
+			gint width,
+			guint32 time)
+{
+  /* get the data for this device */
+  GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, dev);
 
-  if (devdata->cur_context->paint_ctx)
-  {
-    cairo_set_line_cap(devdata->cur_context->paint_ctx, CAIRO_LINE_CAP_ROUND);
-    cairo_set_line_join(devdata->cur_context->paint_ctx, CAIRO_LINE_JOIN_ROUND);
+  GromitStrokeCoordinate point = {x, y, width, time};
+
+  if (!devdata->coordlist)
+    devdata->coordlist = g_array_sized_new (FALSE, FALSE, sizeof (GromitStrokeCoordinate), 256);
 
-    //Erase the beginning of the line in order to keep only the arrow point
-    cairo_set_line_width(devdata->cur_context->paint_ctx, data->maxwidth + 1);
-    cairo_operator_t previous_operator = cairo_get_operator(devdata->cur_context->paint_ctx);
-    cairo_set_operator(devdata->cur_context->paint_ctx, CAIRO_OPERATOR_CLEAR);
-    cairo_move_to(devdata->cur_context->paint_ctx, x1, y1);
-    cairo_line_to(devdata->cur_context->paint_ctx, origin_x, origin_y);
-    cairo_stroke(devdata->cur_context->paint_ctx);
-    cairo_set_operator(devdata->cur_context->paint_ctx, previous_operator);
+  g_array_append_val (devdata->coordlist, point);
+}
 
-    cairo_set_line_width(devdata->cur_context->paint_ctx, 1);
 
-    gdk_cairo_set_source_rgba(devdata->cur_context->paint_ctx, data->switch_color ? data->switch_color : devdata->cur_context->paint_color);
+void coord_list_clear (GromitData *data,
+		       GdkDevice* dev)
+{
+  /* get the data for this device */
+  GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, dev);
 
-    cairo_move_to(devdata->cur_context->paint_ctx, arrowhead[0].x, arrowhead[0].y);
-    cairo_line_to(devdata->cur_context->paint_ctx, arrowhead[1].x, arrowhead[1].y);
-    cairo_line_to(devdata->cur_context->paint_ctx, arrowhead[2].x, arrowhead[2].y);
-    cairo_line_to(devdata->cur_context->paint_ctx, arrowhead[3].x, arrowhead[3].y);
-    cairo_fill(devdata->cur_context->paint_ctx);
+  /* keep the storage around for the next stroke */
+  if (devdata->coordlist)
+    g_array_set_size (devdata->coordlist, 0);
+}
 
-    gdk_cairo_set_source_rgba(devdata->cur_context->paint_ctx, data->black);
 
-    cairo_move_to(devdata->cur_context->paint_ctx, arrowhead[0].x, arrowhead[0].y);
-    cairo_line_to(devdata->cur_context->paint_ctx, arrowhead[1].x, arrowhead[1].y);
-    cairo_line_to(devdata->cur_context->paint_ctx, arrowhead[2].x, arrowhead[2].y);
-    cairo_line_to(devdata->cur_context->paint_ctx, arrowhead[3].x, arrowhead[3].y);
-    cairo_line_to(devdata->cur_context->paint_ctx, arrowhead[0].x, arrowhead[0].y);
-    cairo_stroke(devdata->cur_context->paint_ctx);
+GromitStrokeCoordinate *coord_list_first (GromitDeviceData *devdata)
+{
+  if (!devdata->coordlist || devdata->coordlist->len == 0)
+    return NULL;
+  return &g_array_index (devdata->coordlist, GromitStrokeCoordinate, 0);
+}
 
-    gdk_cairo_set_source_rgba(devdata->cur_context->paint_ctx, data->switch_color ? data->switch_color : devdata->cur_context->paint_color);
 
-    data->modified = 1;
+GromitStrokeCoordinate *coord_list_last (GromitDeviceData *devdata)
+{
+  if (!devdata->coordlist || devdata->coordlist->len == 0)
+    return NULL;
+  return &g_array_index (devdata->coordlist, GromitStrokeCoordinate, devdata->coordlist->len - 1);
+}
 
-    gdk_window_invalidate_rect(gtk_widget_get_window(data->win), &rect, 0);
-  }
 
-  data->painted = 1;
+/*
+  Damage an area of the preview layer: it gets redrawn on screen and
+  rescanned for the window shape, the backbuffer is left alone.
+*/
+static void damage_preview (GromitData *data, const GdkRectangle *rect)
+{
+  GdkRectangle padded = {rect->x - 1, rect->y - 1, rect->width + 2, rect->height + 2};
+
+  data->drawing_ops->damage(data, &padded);
+  shape_damage(data, &padded);
 }
 
-void coord_list_prepend (GromitData *data,
-			 GdkDevice* dev,
-			 gint x,
-			 gint y,
-			 gint width)
+/* Erase rect from the preview layer, giving its tiles back once it is empty. */
+static void preview_erase (GromitData *data, const GdkRectangle *rect)
 {
-  /* get the data for this device */
-  GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, dev);
+  GHashTableIter it;
+  gpointer value;
 
-  GromitStrokeCoordinate *point;
+  cairo_t *cr = cairo_create (data->preview);
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_rectangle (cr, rect->x - 1, rect->y - 1, rect->width + 2, rect->height + 2);
+  cairo_fill (cr);
+  cairo_destroy (cr);
 
-  point = g_malloc (sizeof (GromitStrokeCoordinate));
-  point->x = x;
-  point->y = y;
-  point->width = width;
+  damage_preview (data, rect);
 
-  devdata->coordlist = g_list_prepend (devdata->coordlist, point);
+  g_hash_table_iter_init (&it, data->devdatatable);
+  while (g_hash_table_iter_next (&it, NULL, &value))
+    if (((GromitDeviceData *) value)->has_preview ||
+	((GromitDeviceData *) value)->has_prediction)
+      return;
+  tiled_surface_clear (data->preview);
 }
 
+void preview_clear (GromitData *data, GromitDeviceData *devdata)
+{
+  if (!devdata->has_preview)
+    return;
+
+  devdata->has_preview = FALSE;
+  preview_erase (data, &devdata->preview_rect);
+}
 
-void coord_list_free (GromitData *data,
-		      GdkDevice* dev)
+void prediction_clear (GromitData *data, GromitDeviceData *devdata)
+{
+  if (!devdata->has_prediction)
+    return;
+
+  devdata->has_prediction = FALSE;
+  preview_erase (data, &devdata->prediction_rect);
+}
+
+/*
+  Replace the device's predicted stroke tail on the preview layer by one
+  from its newest point to where the pen is expected to be next.
+*/
+void prediction_draw (GromitData *data, GromitDeviceData *devdata)
+{
+  GromitStrokeCoordinate *last;
+  GdkRectangle rect, padded;
+  gint x, y;
+
+  prediction_clear (data, devdata);
+
+  /* the preview layer is painted over the backbuffer, so only ink can be previewed */
+  if (devdata->cur_context->predict == 0 || devdata->cur_context->type != GROMIT_PEN)
+    return;
+
+  if (!devdata->predictor)
+    devdata->predictor = predictor_new ();
+
+  if (!predictor_update (devdata->predictor, devdata->coordlist,
+			 devdata->cur_context->predict, &x, &y))
+    return;
+
+  last = coord_list_last (devdata);
+
+  cairo_t *cr = cairo_create (data->preview);
+  if(!data->composited)
+    cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
+  gdk_cairo_set_source_rgba(cr, data->switch_color ? data->switch_color : devdata->cur_context->paint_color);
+  paint_line (cr, last->x, last->y, x, y, last->width, &rect);
+  cairo_destroy (cr);
+
+  padded.x = rect.x - 1;
+  padded.y = rect.y - 1;
+  padded.width = rect.width + 2;
+  padded.height = rect.height + 2;
+  tiled_surface_mark (data->preview, &padded);
+  damage_preview (data, &rect);
+
+  devdata->prediction_rect = rect;
+  devdata->has_prediction = TRUE;
+}
+
+void prediction_end (GromitData *data, GromitDeviceData *devdata)
+{
+  gdouble mean, max;
+  guint n;
+
+  prediction_clear (data, devdata);
+
+  if (!devdata->predictor)
+    return;
+
+  predictor_reset (devdata->predictor, &mean, &max, &n);
+  if (n > 0)
+    GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "Device '%s': %u predictions, error mean %.1f px, max %.1f px.",
+		  gdk_device_get_name (devdata->device), n, mean, max);
+}
+
+void preview_shape (GromitData *data,
+		    GdkDevice *dev,
+		    gint x1, gint y1,
+		    gint x2, gint y2)
 {
-  /* get the data for this device */
   GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, dev);
+  GdkRectangle rect, padded;
 
-  GList *ptr;
-  ptr = devdata->coordlist;
+  GROMIT_PROFILE_BEGIN (data, "preview_shape");
 
-  while (ptr)
-    {
-      g_free (ptr->data);
-      ptr = ptr->next;
-    }
+  preview_clear (data, devdata);
 
-  g_list_free (devdata->coordlist);
+  cairo_t *cr = cairo_create (data->preview);
+  if(!data->composited)
+    cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
+  gdk_cairo_set_source_rgba(cr, data->switch_color ? data->switch_color : devdata->cur_context->paint_color);
 
-  devdata->coordlist = NULL;
+  switch (devdata->cur_context->type)
+  {
+  case GROMIT_ELLIPSE:
+    paint_ellipse (cr, x1, y1, x2, y2, devdata->maxwidth, &rect);
+    break;
+  case GROMIT_RECTANGLE:
+    paint_rectangle (cr, x1, y1, x2, y2, devdata->maxwidth, &rect);
+    break;
+  default:
+    paint_line (cr, x1, y1, x2, y2, devdata->maxwidth, &rect);
+    break;
+  }
+
+  cairo_destroy (cr);
+
+  padded.x = rect.x - 1;
+  padded.y = rect.y - 1;
+  padded.width = rect.width + 2;
+  padded.height = rect.height + 2;
+  tiled_surface_mark (data->preview, &padded);
+  damage_preview (data, &rect);
+
+  devdata->preview_rect = rect;
+  devdata->has_preview = TRUE;
+  latency_rasterized (data, devdata);
+
+  GROMIT_PROFILE_END (data, "preview_shape", dev, 2);
 }
 
-void draw_shape_during_motion (
-  GdkEventMotion *ev,
-  GromitDeviceData *devdata,
-  GromitData *data,
-  void (*draw_shape) (GromitData*, GdkDevice*, gint, gint, gint, gint))
+void preview_commit (GromitData *data, GdkDevice *dev)
 {
-  GromitStrokeCoordinate start_point;
-  memcpy(&start_point, g_list_last(devdata->coordlist)->data, sizeof(GromitStrokeCoordinate));
+  GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, dev);
+  GromitStrokeCoordinate *start, *end;
 
-  copy_surface (data->backbuffer, data->motionbuffer);
-  GdkRectangle rect = {0, 0, data->width, data->height};
-  gdk_window_invalidate_rect (gtk_widget_get_window (data->win), &rect, 0);
-  data->modified = 1;
+  if (!devdata->has_preview)
+    return;
+
+  preview_clear (data, devdata);
 
-  draw_shape (data, ev->device, start_point.x, start_point.y, ev->x, ev->y);
+  start = coord_list_first(devdata);
+  end = coord_list_last(devdata);
 
-  coord_list_free (data, ev->device);
-  coord_list_prepend (data, ev->device, start_point.x, start_point.y, start_point.width);
+  switch (devdata->cur_context->type)
+  {
+  case GROMIT_ELLIPSE:
+    draw_ellipse (data, dev, start->x, start->y, end->x, end->y);
+    break;
+  case GROMIT_RECTANGLE:
+    draw_rectangle (data, dev, start->x, start->y, end->x, end->y);
+    break;
+  default:
+    draw_line (data, dev, start->x, start->y, end->x, end->y);
+    break;
+  }
+}
+
+void draw_shape_during_motion (GdkEventMotion *ev,
+			       GromitDeviceData *devdata,
+			       GromitData *data)
+{
+  GromitStrokeCoordinate *start_point = coord_list_first(devdata);
+
+  preview_shape (data, ev->device, start_point->x, start_point->y, ev->x, ev->y);
+  data->modified = 1;
+
+  /* only the start point is needed, the end is where the pointer is */
+  g_array_set_size (devdata->coordlist, 1);
 }
 
-void cleanup_context(GromitPaintContext *context)
+void cleanup_context(GromitDeviceData *devdata)
 {
-  context->start_arrow_painted = FALSE;
+  devdata->start_arrow_painted = FALSE;
 }
 
 gboolean coord_list_get_arrow_param (GromitData *data,
@@ -322,34 +897,39 @@ gboolean coord_list_get_arrow_param (GromitData *data,
   GromitStrokeCoordinate  *cur_point, *valid_point;
   /* get the data for this device */
   GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, dev);
-  GList *ptr;
+  gint i, step, len;
   gfloat width;
 
   valid_point = NULL;
 
+  /* walk inwards from the end of the stroke the arrow goes on */
+  len = devdata->coordlist ? devdata->coordlist->len : 0;
   if(position == GROMIT_ARROW_AT_END)
-    ptr = devdata->coordlist;
-  else if(position == GROMIT_ARROW_AT_START)
-    ptr = g_list_last(devdata->coordlist);
+    {
+      i = len - 1;
+      step = -1;
+    }
+  else
+    {
+      i = 0;
+      step = 1;
+    }
 
-  if (ptr)
+  if (len > 0 && (position == GROMIT_ARROW_AT_END || position == GROMIT_ARROW_AT_START))
     {
-      cur_point = ptr->data;
+      cur_point = &g_array_index (devdata->coordlist, GromitStrokeCoordinate, i);
       x0 = cur_point->x;
       y0 = cur_point->y;
       r2 = search_radius * search_radius;
       dist = 0;
 
-      while (ptr && dist < r2)
+      while (i >= 0 && i < len && dist < r2)
         {
-          if(position == GROMIT_ARROW_AT_END)
-            ptr = ptr->next;
-          else if(position == GROMIT_ARROW_AT_START)
-            ptr = ptr->prev;
+          i += step;
 
-          if (ptr)
+          if (i >= 0 && i < len)
             {
-              cur_point = ptr->data;
+              cur_point = &g_array_index (devdata->coordlist, GromitStrokeCoordinate, i);
               dist = (cur_point->x - x0) * (cur_point->x - x0) +
                      (cur_point->y - y0) * (cur_point->y - y0);
               width = cur_point->width * devdata->cur_context->arrowsize;
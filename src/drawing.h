@@ -13,28 +13,95 @@ typedef struct
   gint x;
   gint y;
   gint width;
+  guint32 time;
 } GromitStrokeCoordinate;
 
+/* A line waiting to be painted on the next frame. */
+typedef struct
+{
+  gint  x1, y1;
+  gint  x2, y2;
+  guint width;
+} GromitSegment;
 
+/*
+  Where the drawing functions report to. damage() is told about every
+  area of the screen that changed, schedule() asks for flush_all_pending()
+  to be called in time for the next frame and shape() is given the window
+  shape without a compositor, see shape.h. The app draws to its window,
+  see window_drawing_ops, the benchmark offscreen.
+*/
+struct _GromitDrawingOps
+{
+  void (*damage) (GromitData *data, const GdkRectangle *rect);
+  void (*schedule) (GromitData *data);
+  void (*shape) (GromitData *data, cairo_region_t *region);
+};
+
+/* Point all devices' cairo contexts at data->backbuffer again after it was replaced. */
+void paint_contexts_retarget (GromitData *data);
+/* Set up the device's cairo context for its current tool. */
+void device_paint_ctx_update (GromitData *data, GromitDeviceData *devdata);
+
+
+void paint_line (cairo_t *cr, gint x1, gint y1, gint x2, gint y2, guint width, GdkRectangle *bounds);
+/*
+  Fill the outline of n segments, which is what stroking each of them
+  with round caps would cover, in one go. Where a segment goes on from
+  the one before, the outline tapers from that one's width to its own.
+*/
+void paint_outline (cairo_t *cr, const GromitSegment *segments, guint n, GdkRectangle *bounds);
+void segment_bounds (const GromitSegment *segments, guint i, GdkRectangle *bounds);
+void paint_ellipse (cairo_t *cr, gint x1, gint y1, gint x2, gint y2, guint width, GdkRectangle *bounds);
+void paint_rectangle (cairo_t *cr, gint x1, gint y1, gint x2, gint y2, guint width, GdkRectangle *bounds);
+void paint_arrow (cairo_t *cr, gint x1, gint y1, gint width, gfloat direction, guint linewidth,
+		  const GdkRGBA *color, const GdkRGBA *outline, GdkRectangle *bounds);
+void damage_backbuffer (GromitData *data, const GdkRectangle *rect);
 void draw_line (GromitData *data, GdkDevice *dev, gint x1, gint y1, gint x2, gint y2);
+/*
+  Freehand strokes are queued per device and painted once per frame, see
+  on_frame_tick(), with all their damage invalidated in one go.
+*/
+void queue_line (GromitData *data, GdkDevice *dev, gint x1, gint y1, gint x2, gint y2);
+void queue_finish (GromitData *data, GromitDeviceData *devdata);
+void flush_pending (GromitData *data, GromitDeviceData *devdata);
+void draw_segments (GromitData *data, GromitDeviceData *devdata, const GromitSegment *segments, guint n);
+guint flush_all_pending (GromitData *data);
 void draw_arrow (GromitData *data, GdkDevice *dev, gint x1, gint y1, gint width, gfloat direction);
 void draw_arrow_when_applicable(GdkDevice *device, GromitDeviceData *devdata, GromitData *data, GromitArrowPosition position);
 void draw_ellipse(GromitData *data, GdkDevice *dev, gint x1, gint y1, gint x2, gint y2);
 void draw_rectangle(GromitData *data, GdkDevice *dev, gint x1, gint y1, gint x2, gint y2);
-void draw_shape_during_motion (
-  GdkEventMotion *ev,
-  GromitDeviceData *devdata,
-  GromitData *data,
-  void (*draw_shape) (GromitData*, GdkDevice*, gint, gint, gint, gint));
-void cleanup_context(GromitPaintContext *context);
+/*
+  In-progress LINE, ELLIPSE and RECTANGLE shapes are shown in the preview
+  layer, drawn over the backbuffer, and only painted into it on release.
+*/
+void preview_shape (GromitData *data, GdkDevice *dev, gint x1, gint y1, gint x2, gint y2);
+void preview_clear (GromitData *data, GromitDeviceData *devdata);
+/*
+  A guess at where the stroke goes next, drawn on the preview layer for
+  tools with the predict option and replaced as real points come in.
+*/
+void prediction_draw (GromitData *data, GromitDeviceData *devdata);
+void prediction_clear (GromitData *data, GromitDeviceData *devdata);
+/* Clear the prediction at the end of a stroke and report its accuracy. */
+void prediction_end (GromitData *data, GromitDeviceData *devdata);
+void preview_commit (GromitData *data, GdkDevice *dev);
+void draw_shape_during_motion (GdkEventMotion *ev, GromitDeviceData *devdata, GromitData *data);
+void cleanup_context(GromitDeviceData *devdata);
 gboolean coord_list_get_arrow_param (GromitData *data,
 					    GdkDevice  					*dev,
 					    gint        				search_radius,
 							GromitArrowPosition arrowposition,
 					    gint       					*ret_width,
 					    gfloat     					*ret_direction);
-void coord_list_prepend (GromitData *data, GdkDevice* dev, gint x, gint y, gint width);
-void coord_list_free (GromitData *data, GdkDevice* dev);
+/*
+  The points of the current stroke in the order they were drawn. The
+  array is only emptied between strokes, not freed.
+*/
+void coord_list_append (GromitData *data, GdkDevice* dev, gint x, gint y, gint width, guint32 time);
+void coord_list_clear (GromitData *data, GdkDevice* dev);
+GromitStrokeCoordinate *coord_list_first (GromitDeviceData *devdata);
+GromitStrokeCoordinate *coord_list_last (GromitDeviceData *devdata);
 
 
 #endif
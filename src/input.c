@@ -16,6 +16,13 @@
 #define WAYLAND_HOTKEY_PREFIX "gromit-mpx-wayland-hotkey"
 
 #include "input.h"
+#include "journal.h"
+#include "drawing.h"
+#include "smooth.h"
+#include "predict.h"
+#include "sampler.h"
+#include "latency.h"
+#include "tools.h"
 
 gint get_keyboard_device_id(GdkDevice *device, GdkDisplay *display);
 void grab_hotkey(GdkDisplay *display, GdkWindow *window, guint keycode, int kbd_dev_id);
@@ -68,8 +75,7 @@ static void remove_hotkeys_from_compositor(GromitData *data) {
 	/*
 	  Get all custom key bindings and save back the ones that are not from us.
 	*/
-	if(data->debug)
-	    g_print("DEBUG: Detected GNOME under Wayland, removing our hotkeys from compositor\n");
+	GROMIT_DEBUG (data, GROMIT_LOG_GRAB, "Detected GNOME under Wayland, removing our hotkeys from compositor");
 
 	GPtrArray *other_key_bindings_mutable_array = g_ptr_array_new();
 
@@ -85,8 +91,7 @@ static void remove_hotkeys_from_compositor(GromitData *data) {
             if (!g_str_has_prefix(name, WAYLAND_HOTKEY_PREFIX)) {
 		g_ptr_array_add(other_key_bindings_mutable_array, strdup(*binding));
             } else {
-		if (data->debug)
-		    g_print("DEBUG:   removing %s with name '%s'\n", *binding, name);
+		GROMIT_DEBUG (data, GROMIT_LOG_GRAB, "  removing %s with name '%s'", *binding, name);
             }
 
             g_free(name);
@@ -107,8 +112,7 @@ static void add_hotkeys_to_compositor(GromitData *data) {
     char *xdg_current_desktop = getenv("XDG_CURRENT_DESKTOP");
     if (xdg_current_desktop && strcmp(xdg_current_desktop, "GNOME") == 0) {
 
-	if(data->debug)
-	    g_print("DEBUG: Detected GNOME under Wayland, adding our hotkeys to compositor\n");
+	GROMIT_DEBUG (data, GROMIT_LOG_GRAB, "Detected GNOME under Wayland, adding our hotkeys to compositor");
 
 	/*
 	  Get highest custom keybinding index, collecting keybindings on the way.
@@ -199,6 +203,65 @@ static void add_hotkeys_to_compositor(GromitData *data) {
     }
 }
 
+static void store_sample (const GromitSample *sample, gpointer user_data)
+{
+#ifdef GDK_WINDOWING_X11
+  GromitData *data = user_data;
+  GHashTableIter it;
+  gpointer value;
+
+  g_hash_table_iter_init (&it, data->devdatatable);
+  while (g_hash_table_iter_next (&it, NULL, &value))
+    {
+      GromitDeviceData *devdata = value;
+      if (devdata->is_grabbed && gdk_x11_device_get_id (devdata->device) == sample->deviceid)
+	{
+	  if (!devdata->samples)
+	    devdata->samples = g_array_new (FALSE, FALSE, sizeof (GromitSample));
+	  g_array_append_vals (devdata->samples, sample, 1);
+	  return;
+	}
+    }
+#endif
+}
+
+
+void collect_samples (GromitData *data)
+{
+  if (data->sampler)
+    sampler_drain (data->sampler, store_sample, data);
+}
+
+
+/* Have the input thread read the grabbed devices only. */
+static void select_sampled (GromitData *data)
+{
+#ifdef GDK_WINDOWING_X11
+  GArray *ids;
+  GHashTableIter it;
+  gpointer value;
+
+  if (!data->sampler)
+    return;
+
+  ids = g_array_new (FALSE, FALSE, sizeof (gint));
+  g_hash_table_iter_init (&it, data->devdatatable);
+  while (g_hash_table_iter_next (&it, NULL, &value))
+    {
+      GromitDeviceData *devdata = value;
+      if (devdata->is_grabbed)
+	{
+	  gint id = gdk_x11_device_get_id (devdata->device);
+	  g_array_append_val (ids, id);
+	}
+    }
+
+  sampler_select (data->sampler, (gint *) ids->data, ids->len);
+  g_array_free (ids, TRUE);
+#endif
+}
+
+
 void setup_input_devices (GromitData *data)
 {
   /* ungrab all */
@@ -209,7 +272,30 @@ void setup_input_devices (GromitData *data)
   gpointer value;
   g_hash_table_iter_init (&it, data->devdatatable);
   while (g_hash_table_iter_next (&it, NULL, &value))
-    g_free(value);
+    {
+      GromitDeviceData *devdata = value;
+      prediction_end(data, devdata);
+      queue_finish(data, devdata);
+      flush_pending(data, devdata);
+      preview_clear(data, devdata);
+      journal_end_stroke(data, devdata);
+      if (devdata->pending)
+	g_array_free(devdata->pending, TRUE);
+      if (devdata->coordlist)
+	g_array_free(devdata->coordlist, TRUE);
+      if (devdata->smoother)
+	smoother_free(devdata->smoother);
+      if (devdata->predictor)
+	predictor_free(devdata->predictor);
+      if (devdata->samples)
+	g_array_free(devdata->samples, TRUE);
+      if (devdata->tool_tables)
+	g_hash_table_destroy(devdata->tool_tables);
+      if (devdata->paint_ctx)
+	cairo_destroy(devdata->paint_ctx);
+      latency_free(devdata->latency);
+      g_free(devdata);
+    }
   g_hash_table_remove_all(data->devdatatable);
 
 
@@ -246,8 +332,7 @@ void setup_input_devices (GromitData *data)
 
 	      if(kbd_dev_id != -1)
 		  	{
-		      if(data->debug)
-			  		g_printerr("DEBUG: Grabbing hotkeys '%s' and '%s' from keyboard '%d' .\n", data->hot_keyval, data->undo_keyval, kbd_dev_id);
+		      GROMIT_DEBUG (data, GROMIT_LOG_GRAB, "Grabbing hotkeys '%s' and '%s' from keyboard '%d' .", data->hot_keyval, data->undo_keyval, kbd_dev_id);
 
 		      gdk_x11_display_error_trap_push(data->display);
 
@@ -275,6 +360,9 @@ void setup_input_devices (GromitData *data)
 	      add_hotkeys_to_compositor(data);
           }
 
+          /* resolve tools now rather than on the first button press */
+          tool_tables_prepare(data, devdata);
+
           g_hash_table_insert(data->devdatatable, device, devdata);
           g_printerr ("Enabled Device %d: \"%s\", (Type: %d)\n",
 		      i++, gdk_device_get_name(device), gdk_device_get_source(device));
@@ -341,9 +429,9 @@ void release_grab (GromitData *data,
 	  }
         }
 
-      if(data->debug)
-        g_printerr ("DEBUG: Ungrabbed all Devices.\n");
+      GROMIT_DEBUG (data, GROMIT_LOG_GRAB, "Ungrabbed all Devices.");
 
+      select_sampled (data);
       indicate_active(data, FALSE);
 
       return;
@@ -372,9 +460,9 @@ void release_grab (GromitData *data,
       devdata->motion_time = 0;
 
 
-      if(data->debug)
-        g_printerr ("DEBUG: Ungrabbed Device '%s'.\n", gdk_device_get_name(devdata->device));
+      GROMIT_DEBUG (data, GROMIT_LOG_GRAB, "Ungrabbed Device '%s'.", gdk_device_get_name(devdata->device));
 
+      select_sampled (data);
       if(!get_are_some_grabbed(data))
 	  indicate_active(data, FALSE);
     }
@@ -450,9 +538,9 @@ void acquire_grab(GromitData *data,
 			devdata->is_grabbed = 1;
 		}
 
-		if (data->debug)
-			g_printerr("DEBUG: Grabbed all Devices.\n");
+		GROMIT_DEBUG (data, GROMIT_LOG_GRAB, "Grabbed all Devices.");
 
+		select_sampled (data);
 		indicate_active(data, TRUE);
 
 		return;
@@ -497,9 +585,9 @@ void acquire_grab(GromitData *data,
 
 		devdata->is_grabbed = 1;
 
-		if (data->debug)
-			g_printerr("DEBUG: Grabbed Device '%s'.\n", gdk_device_get_name(devdata->device));
+		GROMIT_DEBUG (data, GROMIT_LOG_GRAB, "Grabbed Device '%s'.", gdk_device_get_name(devdata->device));
 
+		select_sampled (data);
 		indicate_active(data, TRUE);
 	}
 }
@@ -543,8 +631,7 @@ gint snoop_key_press(GtkWidget   *grab_widget,
   if (event->type == GDK_KEY_PRESS &&
       event->hardware_keycode == data->hot_keycode)
     {
-      if(data->debug)
-	g_printerr("DEBUG: Received hotkey press from device '%s'\n", gdk_device_get_name(dev));
+      GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "Received hotkey press from device '%s'", gdk_device_get_name(dev));
 
       if (event->state & GDK_SHIFT_MASK)
         clear_screen (data);
@@ -560,8 +647,7 @@ gint snoop_key_press(GtkWidget   *grab_widget,
   if (event->type == GDK_KEY_PRESS &&
       event->hardware_keycode == data->undo_keycode)
     {
-      if(data->debug)
-	g_printerr("DEBUG: Received undokey press from device '%s'\n", gdk_device_get_name(dev));
+      GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "Received undokey press from device '%s'", gdk_device_get_name(dev));
 
       if (data->hidden)
         return FALSE;
@@ -11,6 +11,8 @@ void shutdown_input_devices (GromitData *data);
 void release_grab (GromitData *data, GdkDevice *dev);
 void acquire_grab (GromitData *data, GdkDevice *dev);
 void toggle_grab  (GromitData *data, GdkDevice *dev);
+/* Hand the input thread's samples to the devices they belong to. */
+void collect_samples (GromitData *data);
 gint snoop_key_press (GtkWidget *grab_widget, GdkEventKey *event, gpointer func_data);
 
 #endif
@@ -0,0 +1,683 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "journal.h"
+#include "drawing.h"
+#include "shape.h"
+#include "tiles.h"
+#include "pool.h"
+#include "profile.h"
+
+/* Pixels of the backbuffer before a stroke, NULL if they were transparent. */
+typedef struct
+{
+  GdkRectangle     rect;
+  cairo_surface_t *pixels;
+} GromitPatch;
+
+struct _GromitStroke
+{
+  GromitPaintType  type;
+  GdkRGBA          color;
+  gboolean         clear;
+  gboolean         active;
+  GArray          *ops;
+  cairo_region_t  *damage;
+  GArray          *patches;
+  /*
+    For a clear: the backbuffer and shadow from the other side of it,
+    swapped in and out by undo and redo.
+  */
+  cairo_surface_t *snapshot;
+  cairo_surface_t *snapshot_shadow;
+  /* memory used, once the stroke is finished */
+  gsize            bytes;
+};
+
+struct _GromitJournal
+{
+  GPtrArray       *strokes;
+  guint            n_applied;
+  guint            n_active;
+  gsize            bytes;
+  cairo_surface_t *shadow;
+};
+
+
+static void stroke_free (GromitData *data, GromitStroke *stroke)
+{
+  guint i;
+
+  for (i = 0; i < stroke->patches->len; i++)
+    {
+      GromitPatch *patch = &g_array_index (stroke->patches, GromitPatch, i);
+      if (patch->pixels)
+	cairo_surface_destroy (patch->pixels);
+    }
+  g_array_free (stroke->patches, TRUE);
+  g_array_free (stroke->ops, TRUE);
+  cairo_region_destroy (stroke->damage);
+  if (stroke->snapshot)
+    surface_pool_put (data, stroke->snapshot);
+  if (stroke->snapshot_shadow)
+    surface_pool_put (data, stroke->snapshot_shadow);
+  g_free (stroke);
+}
+
+
+static GromitStroke *stroke_new (void)
+{
+  GromitStroke *stroke = g_malloc0 (sizeof (GromitStroke));
+  stroke->ops = g_array_new (FALSE, FALSE, sizeof (GromitJournalOp));
+  stroke->damage = cairo_region_create ();
+  stroke->patches = g_array_new (FALSE, FALSE, sizeof (GromitPatch));
+  return stroke;
+}
+
+
+static gsize stroke_get_bytes (GromitStroke *stroke)
+{
+  gsize bytes = sizeof (GromitStroke) + stroke->ops->len * sizeof (GromitJournalOp);
+  guint i;
+
+  for (i = 0; i < stroke->patches->len; i++)
+    {
+      GromitPatch *patch = &g_array_index (stroke->patches, GromitPatch, i);
+      bytes += sizeof (GromitPatch);
+      if (patch->pixels)
+	bytes += (gsize) cairo_image_surface_get_stride (patch->pixels) * patch->rect.height;
+    }
+
+  if (stroke->snapshot)
+    bytes += tiled_surface_get_populated_bytes (stroke->snapshot)
+      + tiled_surface_get_populated_bytes (stroke->snapshot_shadow);
+
+  return bytes;
+}
+
+
+static void add_rect (const GdkRectangle *rect, gpointer user_data)
+{
+  cairo_rectangle ((cairo_t *) user_data, rect->x, rect->y, rect->width, rect->height);
+}
+
+
+/*
+  Copy one rectangle of src into dst, where src may be NULL for transparency.
+  Tiles of dst are only marked populated if something visible is copied.
+*/
+static void copy_rect (cairo_surface_t *dst, cairo_surface_t *src,
+		       gint src_x, gint src_y, const GdkRectangle *rect)
+{
+  GdkRectangle src_rect = {rect->x - src_x, rect->y - src_y, rect->width, rect->height};
+  gboolean blank = !src || tiled_surface_is_clear (src, &src_rect);
+  cairo_t *cr;
+
+  /* clearing what is clear already would only commit pages */
+  if (blank && tiled_surface_is_clear (dst, rect))
+    return;
+
+  cr = cairo_create (dst);
+  if (src)
+    cairo_set_source_surface (cr, src, src_x, src_y);
+  else
+    cairo_set_source_rgba (cr, 0, 0, 0, 0);
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+  /* only populated tiles need clearing */
+  if (blank)
+    tiled_surface_foreach (dst, rect, add_rect, cr);
+  else
+    cairo_rectangle (cr, rect->x, rect->y, rect->width, rect->height);
+  cairo_fill (cr);
+  cairo_destroy (cr);
+
+  if (!blank)
+    tiled_surface_mark (dst, rect);
+}
+
+
+static void remove_strokes (GromitData *data, guint index, guint n)
+{
+  GromitJournal *journal = data->journal;
+  guint i;
+
+  for (i = index; i < index + n; i++)
+    {
+      GromitStroke *stroke = g_ptr_array_index (journal->strokes, i);
+      journal->bytes -= stroke->bytes;
+      stroke_free (data, stroke);
+    }
+
+  g_ptr_array_remove_range (journal->strokes, index, n);
+}
+
+
+/* Throw away strokes that were undone, they cannot be redone any more. */
+static void drop_redo (GromitData *data)
+{
+  GromitJournal *journal = data->journal;
+
+  if (journal->strokes->len > journal->n_applied)
+    remove_strokes (data, journal->n_applied, journal->strokes->len - journal->n_applied);
+}
+
+
+/* Drop the oldest strokes until the journal fits the budget again. */
+static void trim (GromitData *data)
+{
+  GromitJournal *journal = data->journal;
+  guint n = 0;
+
+  while (journal->n_applied > 0 && journal->bytes > GROMIT_UNDO_BUDGET)
+    {
+      if (((GromitStroke *) g_ptr_array_index (journal->strokes, 0))->active)
+	break;
+
+      remove_strokes (data, 0, 1);
+      journal->n_applied--;
+      n++;
+    }
+
+  if (n)
+    GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "Journal over budget, dropped %u oldest strokes.", n);
+}
+
+
+static void damage_all (GromitData *data)
+{
+  GdkRectangle rect = {0, 0, data->width, data->height};
+  data->drawing_ops->damage (data, &rect);
+  shape_damage (data, &rect);
+}
+
+
+/* Save the pixels under the stroke's damage from the shadow. */
+static void save_patches (GromitData *data, GromitStroke *stroke)
+{
+  gint i, n = cairo_region_num_rectangles (stroke->damage);
+
+  for (i = 0; i < n; i++)
+    {
+      GromitPatch patch = {{0, 0, 0, 0}, NULL};
+      cairo_region_get_rectangle (stroke->damage, i, &patch.rect);
+
+      if (!tiled_surface_is_clear (data->journal->shadow, &patch.rect))
+	{
+	  GdkRectangle r = {0, 0, patch.rect.width, patch.rect.height};
+	  patch.pixels = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+						     patch.rect.width, patch.rect.height);
+	  copy_rect (patch.pixels, data->journal->shadow, -patch.rect.x, -patch.rect.y, &r);
+	}
+
+      g_array_append_val (stroke->patches, patch);
+    }
+}
+
+
+/*
+  Undoing or redoing a clear exchanges the current surfaces with the ones
+  kept in the journal entry, no pixels need to be touched.
+*/
+static void swap_clear (GromitData *data, GromitStroke *stroke)
+{
+  cairo_surface_t *tmp;
+
+  tmp = data->backbuffer;
+  data->backbuffer = stroke->snapshot;
+  stroke->snapshot = tmp;
+
+  tmp = data->journal->shadow;
+  data->journal->shadow = stroke->snapshot_shadow;
+  stroke->snapshot_shadow = tmp;
+
+  paint_contexts_retarget (data);
+  damage_all (data);
+}
+
+
+/* Paint the stroke's operations with cr, damaging the backbuffer if asked to. */
+static void paint_stroke (GromitData *data, GromitStroke *stroke, cairo_t *cr, gboolean damage)
+{
+  GdkRectangle rect;
+  GArray *segments;
+  guint i;
+
+  segments = g_array_new (FALSE, FALSE, sizeof (GromitSegment));
+  if(!data->composited)
+    cairo_set_antialias (cr, CAIRO_ANTIALIAS_NONE);
+  gdk_cairo_set_source_rgba (cr, &stroke->color);
+
+  if (stroke->type == GROMIT_ERASER)
+    cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  else
+    if (stroke->type == GROMIT_RECOLOR)
+      cairo_set_operator (cr, CAIRO_OPERATOR_ATOP);
+    else
+      cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+
+  for (i = 0; i < stroke->ops->len; i++)
+    {
+      GromitJournalOp *op = &g_array_index (stroke->ops, GromitJournalOp, i);
+
+      switch (op->type)
+	{
+	case GROMIT_OP_LINE:
+	  {
+	    /* consecutive lines are filled as one outline, as when drawn */
+	    g_array_set_size (segments, 0);
+	    for (;;)
+	      {
+		GromitSegment segment = {op->x1, op->y1, op->x2, op->y2, op->width};
+		g_array_append_val (segments, segment);
+		if (i + 1 >= stroke->ops->len || (op + 1)->type != GROMIT_OP_LINE)
+		  break;
+		op++;
+		i++;
+	      }
+	    paint_outline (cr, (GromitSegment *) segments->data, segments->len, &rect);
+	  }
+	  break;
+	case GROMIT_OP_ELLIPSE:
+	  paint_ellipse (cr, op->x1, op->y1, op->x2, op->y2, op->width, &rect);
+	  break;
+	case GROMIT_OP_RECTANGLE:
+	  paint_rectangle (cr, op->x1, op->y1, op->x2, op->y2, op->width, &rect);
+	  break;
+	case GROMIT_OP_ARROW:
+	  paint_arrow (cr, op->x1, op->y1, op->x2, op->direction, op->width,
+		       &stroke->color, data->black, &rect);
+	  break;
+	}
+
+      if (damage)
+	damage_backbuffer (data, &rect);
+    }
+
+  g_array_free (segments, TRUE);
+}
+
+
+/*
+  Bring the shadow up to date with a finished stroke. Where other strokes
+  are still being drawn, the backbuffer holds their ink as well, so there
+  the stroke's own operations are painted onto the shadow instead.
+*/
+static void update_shadow (GromitData *data, GromitStroke *stroke)
+{
+  GromitJournal *journal = data->journal;
+  cairo_region_t *copied = cairo_region_copy (stroke->damage);
+  cairo_region_t *painted = cairo_region_create ();
+  gint i, n;
+
+  for (i = 0; i < (gint) journal->strokes->len; i++)
+    {
+      GromitStroke *other = g_ptr_array_index (journal->strokes, i);
+      if (other->active && other != stroke)
+	cairo_region_union (painted, other->damage);
+    }
+  cairo_region_intersect (painted, stroke->damage);
+  cairo_region_subtract (copied, painted);
+
+  n = cairo_region_num_rectangles (copied);
+  for (i = 0; i < n; i++)
+    {
+      cairo_rectangle_int_t rect;
+      cairo_region_get_rectangle (copied, i, &rect);
+      if (tiled_surface_is_clear (data->backbuffer, &rect)
+	  && tiled_surface_is_clear (journal->shadow, &rect))
+	continue;
+      copy_rect (journal->shadow, data->backbuffer, 0, 0, &rect);
+    }
+
+  if (!cairo_region_is_empty (painted))
+    {
+      cairo_t *cr = cairo_create (journal->shadow);
+      gdk_cairo_region (cr, painted);
+      cairo_clip (cr);
+      paint_stroke (data, stroke, cr, FALSE);
+      cairo_destroy (cr);
+
+      n = cairo_region_num_rectangles (painted);
+      for (i = 0; i < n; i++)
+	{
+	  cairo_rectangle_int_t rect;
+	  cairo_region_get_rectangle (painted, i, &rect);
+	  tiled_surface_mark (journal->shadow, &rect);
+	}
+    }
+
+  cairo_region_destroy (painted);
+  cairo_region_destroy (copied);
+}
+
+
+static void replay_stroke (GromitData *data, GromitStroke *stroke)
+{
+  cairo_t *cr;
+
+  if (stroke->clear)
+    {
+      swap_clear (data, stroke);
+      return;
+    }
+
+  cr = cairo_create (data->backbuffer);
+  paint_stroke (data, stroke, cr, TRUE);
+  cairo_destroy (cr);
+
+  update_shadow (data, stroke);
+}
+
+
+static void restore_stroke (GromitData *data, GromitStroke *stroke)
+{
+  guint i;
+
+  if (stroke->clear)
+    {
+      swap_clear (data, stroke);
+      return;
+    }
+
+  for (i = 0; i < stroke->patches->len; i++)
+    {
+      GromitPatch *patch = &g_array_index (stroke->patches, GromitPatch, i);
+      copy_rect (data->backbuffer, patch->pixels, patch->rect.x, patch->rect.y, &patch->rect);
+      copy_rect (data->journal->shadow, patch->pixels, patch->rect.x, patch->rect.y, &patch->rect);
+      damage_backbuffer (data, &patch->rect);
+    }
+}
+
+
+void journal_init (GromitData *data)
+{
+  GromitJournal *journal = g_malloc0 (sizeof (GromitJournal));
+
+  journal->strokes = g_ptr_array_new ();
+  journal->shadow = surface_pool_get (data);
+  tiled_surface_copy (journal->shadow, data->backbuffer);
+  data->journal = journal;
+}
+
+
+static void resize_surface (GromitData *data, cairo_surface_t **surface)
+{
+  *surface = tiled_surface_resize (*surface, data->width, data->height);
+}
+
+
+void journal_resize (GromitData *data)
+{
+  GromitJournal *journal = data->journal;
+  guint i;
+
+  resize_surface (data, &journal->shadow);
+
+  /* these might get swapped in as backbuffer again */
+  for (i = 0; i < journal->strokes->len; i++)
+    {
+      GromitStroke *stroke = g_ptr_array_index (journal->strokes, i);
+      if (stroke->clear)
+	{
+	  resize_surface (data, &stroke->snapshot);
+	  resize_surface (data, &stroke->snapshot_shadow);
+	}
+    }
+}
+
+
+/*
+  Clear the pixels a stroke saved outside keep. Patches entirely outside
+  become transparent ones and give their pixels back.
+*/
+static void clip_patches (GromitStroke *stroke, const cairo_region_t *keep)
+{
+  guint i;
+
+  for (i = 0; i < stroke->patches->len; i++)
+    {
+      GromitPatch *patch = &g_array_index (stroke->patches, GromitPatch, i);
+      cairo_region_t *kept;
+
+      if (!patch->pixels)
+	continue;
+
+      switch (cairo_region_contains_rectangle (keep, &patch->rect))
+	{
+	case CAIRO_REGION_OVERLAP_IN:
+	  break;
+	case CAIRO_REGION_OVERLAP_OUT:
+	  cairo_surface_destroy (patch->pixels);
+	  patch->pixels = NULL;
+	  break;
+	case CAIRO_REGION_OVERLAP_PART:
+	  /* patch pixels start at the patch's corner */
+	  kept = cairo_region_copy (keep);
+	  cairo_region_translate (kept, -patch->rect.x, -patch->rect.y);
+	  tiled_surface_clip (patch->pixels, kept);
+	  cairo_region_destroy (kept);
+	  break;
+	}
+    }
+}
+
+
+void journal_clip (GromitData *data, const cairo_region_t *keep)
+{
+  GromitJournal *journal = data->journal;
+  guint i;
+
+  tiled_surface_clip (journal->shadow, keep);
+
+  for (i = 0; i < journal->strokes->len; i++)
+    {
+      GromitStroke *stroke = g_ptr_array_index (journal->strokes, i);
+      if (stroke->clear)
+	{
+	  tiled_surface_clip (stroke->snapshot, keep);
+	  tiled_surface_clip (stroke->snapshot_shadow, keep);
+	}
+      clip_patches (stroke, keep);
+
+      /* active strokes are only counted once they end */
+      if (!stroke->active)
+	{
+	  journal->bytes -= stroke->bytes;
+	  stroke->bytes = stroke_get_bytes (stroke);
+	  journal->bytes += stroke->bytes;
+	}
+    }
+}
+
+
+void journal_begin_stroke (GromitData *data, GromitDeviceData *devdata)
+{
+  GromitJournal *journal = data->journal;
+
+  if (devdata->stroke)
+    journal_end_stroke (data, devdata);
+
+  drop_redo (data);
+
+  devdata->stroke = stroke_new ();
+  devdata->stroke->active = TRUE;
+  g_ptr_array_add (journal->strokes, devdata->stroke);
+  journal->n_applied++;
+  journal->n_active++;
+}
+
+
+void journal_add_op (GromitDeviceData *devdata, const GromitJournalOp *op, const GdkRectangle *bounds)
+{
+  journal_add_ops (devdata, op, 1, bounds);
+}
+
+
+void journal_add_ops (GromitDeviceData *devdata, const GromitJournalOp *ops, guint n, const GdkRectangle *bounds)
+{
+  GromitStroke *stroke = devdata->stroke;
+  /* same padding as damage_backbuffer() */
+  GdkRectangle padded = {bounds->x - 1, bounds->y - 1, bounds->width + 2, bounds->height + 2};
+
+  if (!stroke)
+    return;
+
+  /* take tool and colour from what the stroke actually gets painted with */
+  if (n == 0)
+    return;
+
+  if (stroke->ops->len == 0)
+    {
+      gdouble r, g, b, a;
+      cairo_pattern_get_rgba (cairo_get_source (devdata->paint_ctx), &r, &g, &b, &a);
+      stroke->color.red = r;
+      stroke->color.green = g;
+      stroke->color.blue = b;
+      stroke->color.alpha = a;
+      stroke->type = devdata->cur_context->type;
+    }
+
+  g_array_append_vals (stroke->ops, ops, n);
+  cairo_region_union_rectangle (stroke->damage, &padded);
+}
+
+
+void journal_end_stroke (GromitData *data, GromitDeviceData *devdata)
+{
+  GromitJournal *journal = data->journal;
+  GromitStroke *stroke = devdata->stroke;
+  GdkRectangle bounds = {0, 0, data->width, data->height};
+
+  if (!stroke)
+    return;
+
+  GROMIT_PROFILE_BEGIN (data, "journal_end_stroke");
+
+  devdata->stroke = NULL;
+  stroke->active = FALSE;
+  journal->n_active--;
+
+  /*
+    Other devices' strokes may have begun after this one and ended before
+    it. The shadow follows strokes in the order they end, so they are
+    undone in that order too. Undo never passes a stroke being drawn, so
+    this one is among the applied strokes.
+  */
+  g_ptr_array_remove (journal->strokes, stroke);
+  journal->n_applied--;
+
+  /* nothing got painted, so there is nothing to undo either */
+  if (stroke->ops->len == 0)
+    {
+      stroke_free (data, stroke);
+      GROMIT_PROFILE_END (data, "journal_end_stroke", devdata->device, 0);
+      return;
+    }
+
+  g_ptr_array_insert (journal->strokes, journal->n_applied, stroke);
+  journal->n_applied++;
+
+  cairo_region_intersect_rectangle (stroke->damage, &bounds);
+  save_patches (data, stroke);
+  update_shadow (data, stroke);
+
+  stroke->bytes = stroke_get_bytes (stroke);
+  journal->bytes += stroke->bytes;
+
+  trim (data);
+
+  GROMIT_PROFILE_END (data, "journal_end_stroke", devdata->device, stroke->ops->len);
+
+  GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "Journal has %u strokes, %" G_GSIZE_FORMAT " bytes, last stroke saved %u patches.",
+		journal->strokes->len, journal->bytes, stroke->patches->len);
+}
+
+
+void journal_add_clear (GromitData *data)
+{
+  GromitJournal *journal = data->journal;
+  GromitStroke *stroke;
+
+  /* clearing a screen that is blank already need not be undone */
+  if (journal->n_active == 0 && tiled_surface_get_populated_bytes (data->backbuffer) == 0)
+    return;
+
+  drop_redo (data);
+
+  /* keep the old surfaces and carry on with blank ones */
+  stroke = stroke_new ();
+  stroke->clear = TRUE;
+  stroke->snapshot = surface_pool_get (data);
+  stroke->snapshot_shadow = surface_pool_get (data);
+  swap_clear (data, stroke);
+  stroke->bytes = stroke_get_bytes (stroke);
+  journal->bytes += stroke->bytes;
+  g_ptr_array_add (journal->strokes, stroke);
+  journal->n_applied++;
+
+  trim (data);
+}
+
+
+gboolean journal_undo (GromitData *data)
+{
+  GromitJournal *journal = data->journal;
+  GromitStroke *stroke;
+
+  if (journal->n_applied == 0)
+    return FALSE;
+
+  /* a stroke that is still being drawn cannot be taken back */
+  stroke = g_ptr_array_index (journal->strokes, journal->n_applied - 1);
+  if (stroke->active)
+    return FALSE;
+
+  GROMIT_PROFILE_BEGIN (data, "journal_undo");
+  restore_stroke (data, stroke);
+  journal->n_applied--;
+  GROMIT_PROFILE_END (data, "journal_undo", NULL, -1);
+
+  return TRUE;
+}
+
+
+gboolean journal_redo (GromitData *data)
+{
+  GromitJournal *journal = data->journal;
+
+  if (journal->n_applied >= journal->strokes->len)
+    return FALSE;
+
+  GROMIT_PROFILE_BEGIN (data, "journal_redo");
+  replay_stroke (data, g_ptr_array_index (journal->strokes, journal->n_applied));
+  journal->n_applied++;
+  GROMIT_PROFILE_END (data, "journal_redo", NULL, -1);
+
+  return TRUE;
+}
+
+
+gsize journal_get_bytes (GromitData *data)
+{
+  return data->journal->bytes;
+}
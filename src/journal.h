@@ -0,0 +1,94 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+/*
+  Stroke journal for undo/redo.
+
+  Every stroke is recorded as the list of drawing operations it was made
+  of, together with the tool and colour it was drawn with. When a stroke
+  ends, the pixels it covered are saved as they were before the stroke,
+  taken from a shadow copy of the backbuffer that only follows finished
+  strokes. Undo blits these patches back, redo replays the operations.
+  Strokes of several devices drawn at once are undone in the order they
+  ended, which is the order the shadow took them in.
+  Once the journal uses more than GROMIT_UNDO_BUDGET bytes, the oldest
+  strokes are dropped and cannot be undone any more.
+*/
+
+#include "main.h"
+
+#define GROMIT_UNDO_BUDGET (64 * 1024 * 1024)
+
+typedef enum
+{
+  GROMIT_OP_LINE,
+  GROMIT_OP_ELLIPSE,
+  GROMIT_OP_RECTANGLE,
+  GROMIT_OP_ARROW
+} GromitJournalOpType;
+
+/*
+  One drawing operation. For lines, ellipses and rectangles x1,y1 and x2,y2
+  are the two points passed to the draw function. For arrows x1,y1 is the
+  tip, x2 the arrow width and direction its angle.
+*/
+typedef struct
+{
+  GromitJournalOpType type;
+  gint   x1, y1;
+  gint   x2, y2;
+  guint  width;
+  gfloat direction;
+} GromitJournalOp;
+
+void journal_init (GromitData *data);
+/* Follow a change of the backbuffer size. */
+void journal_resize (GromitData *data);
+/* Follow the backbuffer being cleared outside keep. */
+void journal_clip (GromitData *data, const cairo_region_t *keep);
+
+/* Start recording a new stroke for the device, dropping any redo history. */
+void journal_begin_stroke (GromitData *data, GromitDeviceData *devdata);
+/* Record an operation that was painted, touching bounds. */
+void journal_add_op (GromitDeviceData *devdata, const GromitJournalOp *op, const GdkRectangle *bounds);
+/* Record n operations that were painted together, touching bounds. */
+void journal_add_ops (GromitDeviceData *devdata, const GromitJournalOp *ops, guint n, const GdkRectangle *bounds);
+void journal_end_stroke (GromitData *data, GromitDeviceData *devdata);
+
+/*
+  Record that the screen is about to be cleared. This swaps in a blank
+  backbuffer unless the screen is blank already.
+*/
+void journal_add_clear (GromitData *data);
+
+/* Step back or forth one stroke, returning FALSE if there was nothing to do. */
+gboolean journal_undo (GromitData *data);
+gboolean journal_redo (GromitData *data);
+
+/* Bytes held by the journal for undo. */
+gsize journal_get_bytes (GromitData *data);
+
+#endif
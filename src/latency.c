@@ -0,0 +1,237 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <string.h>
+
+#include "latency.h"
+
+/* event times further back than this are not on our clock */
+#define GROMIT_LATENCY_MAX_AGE 10000 /* ms */
+
+static const gchar *stage_names[GROMIT_LATENCY_STAGES] = { "received", "rasterized", "displayed" };
+
+
+GromitLatency *latency_new (void)
+{
+  return g_new0 (GromitLatency, 1);
+}
+
+
+void latency_free (GromitLatency *latency)
+{
+  g_free (latency);
+}
+
+
+/* Microseconds since the X server stamped an event, -1 if unknown. */
+static gint64 since_event (guint32 time)
+{
+  guint32 age = (guint32) (g_get_monotonic_time () / 1000) - time;
+
+  if (age > GROMIT_LATENCY_MAX_AGE)
+    return -1;
+
+  return (gint64) age * 1000;
+}
+
+
+static void record (GromitData *data,
+		    GromitDeviceData *devdata,
+		    GromitLatencyStage stage,
+		    guint32 time)
+{
+  static gboolean warned = FALSE;
+  gint64 usec = since_event (time);
+  guint bucket;
+
+  if (usec < 0)
+    {
+      if (!warned)
+	GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "Event times are not on the monotonic clock, not measuring latency.");
+      warned = TRUE;
+      return;
+    }
+
+  if (!data->latency)
+    data->latency = latency_new ();
+  if (!devdata->latency)
+    devdata->latency = latency_new ();
+
+  bucket = MIN (usec / 100, GROMIT_LATENCY_BUCKETS);
+
+  data->latency->stages[stage].counts[bucket]++;
+  data->latency->stages[stage].n++;
+  devdata->latency->stages[stage].counts[bucket]++;
+  devdata->latency->stages[stage].n++;
+}
+
+
+/* Upper edge of the bucket holding the given fraction of samples, -1 if beyond the last. */
+static gint64 percentile (const GromitLatencyHistogram *histogram, gdouble p)
+{
+  guint64 rank = (guint64) (p * histogram->n + 0.5);
+  guint64 seen = 0;
+  guint i;
+
+  if (rank == 0)
+    rank = 1;
+
+  for (i = 0; i < GROMIT_LATENCY_BUCKETS; i++)
+    {
+      seen += histogram->counts[i];
+      if (seen >= rank)
+	return (i + 1) * 100;
+    }
+
+  return -1;
+}
+
+
+static void format_ms (gchar *buf, gsize size, gint64 usec)
+{
+  if (usec < 0)
+    g_snprintf (buf, size, ">%d ms", GROMIT_LATENCY_BUCKETS / 10);
+  else
+    g_snprintf (buf, size, "%.1f ms", usec / 1000.0);
+}
+
+
+/* One line on a stage's percentiles, NULL if it saw no events. */
+static gchar *format_stage (const GromitLatency *latency, gint stage)
+{
+  const GromitLatencyHistogram *histogram = &latency->stages[stage];
+  gchar p50[16], p95[16], p99[16];
+
+  if (histogram->n == 0)
+    return NULL;
+
+  format_ms (p50, sizeof (p50), percentile (histogram, 0.50));
+  format_ms (p95, sizeof (p95), percentile (histogram, 0.95));
+  format_ms (p99, sizeof (p99), percentile (histogram, 0.99));
+
+  return g_strdup_printf ("%-10s p50 %s, p95 %s, p99 %s over %" G_GUINT64_FORMAT " events",
+			  stage_names[stage], p50, p95, p99, histogram->n);
+}
+
+
+static void print (const GromitLatency *latency, const gchar *prefix)
+{
+  gint stage;
+
+  for (stage = 0; stage < GROMIT_LATENCY_STAGES; stage++)
+    {
+      gchar *line = format_stage (latency, stage);
+      if (line)
+	g_printerr ("%s%s\n", prefix, line);
+      g_free (line);
+    }
+}
+
+
+static void stroke_report (GromitData *data, GromitDeviceData *devdata)
+{
+  gint stage;
+
+  devdata->latency_report = FALSE;
+
+  if (!devdata->latency)
+    return;
+
+  if (data->log_levels[GROMIT_LOG_INPUT] >= GROMIT_LOG_DEBUG)
+    for (stage = 0; stage < GROMIT_LATENCY_STAGES; stage++)
+      {
+	gchar *line = format_stage (devdata->latency, stage);
+	if (line)
+	  GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "Stroke latency, %s", line);
+	g_free (line);
+      }
+
+  memset (devdata->latency, 0, sizeof (GromitLatency));
+}
+
+
+void latency_received (GromitData *data, GromitDeviceData *devdata, guint32 time)
+{
+  record (data, devdata, GROMIT_LATENCY_RECEIVED, time);
+
+  /* the oldest event waiting is the one that waits longest */
+  if (!devdata->latency_pending)
+    devdata->latency_pending = time;
+}
+
+
+void latency_rasterized (GromitData *data, GromitDeviceData *devdata)
+{
+  if (!devdata->latency_pending)
+    return;
+
+  record (data, devdata, GROMIT_LATENCY_RASTERIZED, devdata->latency_pending);
+
+  if (!devdata->latency_drawn)
+    devdata->latency_drawn = devdata->latency_pending;
+  devdata->latency_pending = 0;
+}
+
+
+void latency_displayed (GromitData *data)
+{
+  GHashTableIter it;
+  gpointer value;
+
+  g_hash_table_iter_init (&it, data->devdatatable);
+  while (g_hash_table_iter_next (&it, NULL, &value))
+    {
+      GromitDeviceData *devdata = value;
+
+      if (devdata->latency_drawn)
+	{
+	  record (data, devdata, GROMIT_LATENCY_DISPLAYED, devdata->latency_drawn);
+	  devdata->latency_drawn = 0;
+	}
+
+      if (devdata->latency_report && !devdata->latency_pending)
+	stroke_report (data, devdata);
+    }
+}
+
+
+void latency_end_stroke (GromitData *data, GromitDeviceData *devdata)
+{
+  devdata->latency_report = TRUE;
+
+  if (!devdata->latency_pending && !devdata->latency_drawn)
+    stroke_report (data, devdata);
+}
+
+
+void latency_dump (GromitData *data)
+{
+  if (!data->latency)
+    {
+      g_printerr ("No latency measured yet.\n");
+      return;
+    }
+
+  g_printerr ("Latency since the input event was generated:\n");
+  print (data->latency, "  ");
+}
@@ -0,0 +1,76 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+/*
+  Input-to-display latency.
+
+  For every motion event that draws, the time since the X server stamped
+  it is taken when it is received in on_motion(), when its ink is
+  rasterized and when the frame holding it has been drawn in on_expose().
+  The times go into histograms of 0.1 ms buckets, one set per stroke and
+  one for the whole session. Event times have millisecond resolution and
+  are assumed to be on the monotonic clock, as they are with Xorg.
+*/
+
+#include "main.h"
+
+#define GROMIT_LATENCY_BUCKETS 1000 /* 0.1 ms each, up to 100 ms */
+
+typedef enum
+{
+  GROMIT_LATENCY_RECEIVED,
+  GROMIT_LATENCY_RASTERIZED,
+  GROMIT_LATENCY_DISPLAYED,
+  GROMIT_LATENCY_STAGES
+} GromitLatencyStage;
+
+typedef struct
+{
+  guint32 counts[GROMIT_LATENCY_BUCKETS + 1]; /* the last one holds anything slower */
+  guint64 n;
+} GromitLatencyHistogram;
+
+struct _GromitLatency
+{
+  GromitLatencyHistogram stages[GROMIT_LATENCY_STAGES];
+};
+
+GromitLatency *latency_new (void);
+void latency_free (GromitLatency *latency);
+
+/* An event with the given time was received for the device. */
+void latency_received (GromitData *data, GromitDeviceData *devdata, guint32 time);
+/* What the device received so far has been drawn into the backbuffer. */
+void latency_rasterized (GromitData *data, GromitDeviceData *devdata);
+/* What was drawn into the backbuffer has been drawn onto the window. */
+void latency_displayed (GromitData *data);
+/* The device's stroke is over, report it once it is on screen. */
+void latency_end_stroke (GromitData *data, GromitDeviceData *devdata);
+
+/* Print p50/p95/p99 of every stage for the whole session. */
+void latency_dump (GromitData *data);
+
+#endif
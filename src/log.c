@@ -0,0 +1,220 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+
+/* how often the writer thread looks for new messages */
+#define GROMIT_LOG_FLUSH_INTERVAL 20000 /* us */
+
+typedef struct
+{
+  gint   seq;     /* position + 1 once the message is complete */
+  guint8 category;
+  guint8 level;
+  gchar  text[GROMIT_LOG_LINE_SIZE];
+} LogSlot;
+
+static const gchar *category_names[GROMIT_LOG_CATEGORIES] = { "input", "draw", "tool", "grab", "ipc" };
+static const gchar *level_names[] = { "off", "info", "debug", "trace" };
+static const gchar *level_labels[] = { "", "INFO", "DEBUG", "TRACE" };
+
+static LogSlot  slots[GROMIT_LOG_RING_SIZE];
+static gint     head;     /* next position to write to */
+static gint     tail;     /* next position to write out */
+static gint     dropped;
+static gint     running;
+static GThread *writer;
+
+
+void log_write (GromitLogCategory category,
+		GromitLogLevel level,
+		const gchar *format, ...)
+{
+  LogSlot *slot;
+  guint pos;
+  va_list args;
+
+  /* claim a slot, several threads may be at it */
+  do
+    {
+      pos = g_atomic_int_get (&head);
+      if (pos - (guint) g_atomic_int_get (&tail) >= GROMIT_LOG_RING_SIZE)
+	{
+	  g_atomic_int_inc (&dropped);
+	  return;
+	}
+    }
+  while (!g_atomic_int_compare_and_exchange (&head, pos, pos + 1));
+
+  slot = &slots[pos & (GROMIT_LOG_RING_SIZE - 1)];
+  slot->category = category;
+  slot->level = level;
+  va_start (args, format);
+  g_vsnprintf (slot->text, sizeof (slot->text), format, args);
+  va_end (args);
+
+  g_atomic_int_set (&slot->seq, pos + 1);
+}
+
+
+/* Write out all complete messages in one go. */
+static void log_flush (void)
+{
+  GString *out = g_string_new (NULL);
+  guint pos = g_atomic_int_get (&tail);
+  gint n;
+
+  for (;; pos++)
+    {
+      LogSlot *slot = &slots[pos & (GROMIT_LOG_RING_SIZE - 1)];
+      gsize len;
+
+      if ((guint) g_atomic_int_get (&slot->seq) != pos + 1)
+	break;
+
+      g_string_append_printf (out, "%s: %s: %s", level_labels[slot->level],
+			      category_names[slot->category], slot->text);
+      len = strlen (slot->text);
+      if (len == 0 || slot->text[len - 1] != '\n')
+	g_string_append_c (out, '\n');
+
+      /* hand the slot back */
+      g_atomic_int_set (&tail, pos + 1);
+    }
+
+  n = g_atomic_int_get (&dropped);
+  if (n > 0)
+    {
+      g_atomic_int_add (&dropped, -n);
+      g_string_append_printf (out, "log: %d messages dropped\n", n);
+    }
+
+  if (out->len > 0)
+    {
+      fwrite (out->str, 1, out->len, stderr);
+      fflush (stderr);
+    }
+  g_string_free (out, TRUE);
+}
+
+
+static gpointer log_writer (gpointer user_data)
+{
+  while (g_atomic_int_get (&running))
+    {
+      log_flush ();
+      g_usleep (GROMIT_LOG_FLUSH_INTERVAL);
+    }
+
+  return NULL;
+}
+
+
+void log_init (void)
+{
+  if (writer)
+    return;
+
+  g_atomic_int_set (&running, 1);
+  writer = g_thread_new ("gromit-log", log_writer, NULL);
+}
+
+
+void log_shutdown (void)
+{
+  if (writer)
+    {
+      g_atomic_int_set (&running, 0);
+      g_thread_join (writer);
+      writer = NULL;
+    }
+
+  log_flush ();
+}
+
+
+void log_set_all (guint8 *levels, GromitLogLevel level)
+{
+  gint i;
+
+  for (i = 0; i < GROMIT_LOG_CATEGORIES; i++)
+    levels[i] = MAX (levels[i], level);
+}
+
+
+gboolean log_parse (guint8 *levels, const gchar *spec)
+{
+  gchar **items = g_strsplit (spec, ",", -1);
+  gboolean ok = TRUE;
+  gint i, c, l;
+
+  for (i = 0; items[i] && ok; i++)
+    {
+      gchar *name = g_strstrip (items[i]);
+      gchar *colon = strchr (name, ':');
+      gint level = GROMIT_LOG_DEBUG;
+      gint category = -1;
+
+      if (colon)
+	{
+	  *colon = '\0';
+	  level = -1;
+	  for (l = 0; l < (gint) G_N_ELEMENTS (level_names); l++)
+	    if (strcmp (colon + 1, level_names[l]) == 0)
+	      level = l;
+	  if (level < 0)
+	    {
+	      g_printerr ("Unknown log level \"%s\"\n", colon + 1);
+	      ok = FALSE;
+	      break;
+	    }
+	}
+
+#ifndef GROMIT_TRACE_LOG
+      if (level == GROMIT_LOG_TRACE)
+	g_printerr ("Trace messages are not compiled in, see the GROMIT_TRACE_LOG build option.\n");
+#endif
+
+      for (c = 0; c < GROMIT_LOG_CATEGORIES; c++)
+	if (strcmp (name, category_names[c]) == 0)
+	  category = c;
+
+      if (strcmp (name, "all") == 0)
+	for (c = 0; c < GROMIT_LOG_CATEGORIES; c++)
+	  levels[c] = level;
+      else if (category >= 0)
+	levels[category] = level;
+      else
+	{
+	  g_printerr ("Unknown log category \"%s\"\n", name);
+	  ok = FALSE;
+	}
+    }
+
+  g_strfreev (items);
+  return ok;
+}
@@ -0,0 +1,91 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+/*
+  Leveled logging by category.
+
+  Messages go into a fixed size in-memory ring that any thread can write
+  to without locking, and are written out to stderr in batches by a
+  thread of their own, so that logging does not stall drawing. Should the
+  ring be full, messages are dropped and counted. Which categories log at
+  which level is set per GromitData with -d and --log. Trace messages of
+  the hot paths are only compiled in with the GROMIT_TRACE_LOG build option.
+*/
+
+#include <glib.h>
+
+#include "build-config.h"
+
+typedef enum
+{
+  GROMIT_LOG_INPUT,
+  GROMIT_LOG_DRAW,
+  GROMIT_LOG_TOOL,
+  GROMIT_LOG_GRAB,
+  GROMIT_LOG_IPC,
+  GROMIT_LOG_CATEGORIES
+} GromitLogCategory;
+
+typedef enum
+{
+  GROMIT_LOG_OFF,
+  GROMIT_LOG_INFO,
+  GROMIT_LOG_DEBUG,
+  GROMIT_LOG_TRACE
+} GromitLogLevel;
+
+#define GROMIT_LOG_RING_SIZE 1024 /* messages, must be a power of two */
+#define GROMIT_LOG_LINE_SIZE 240
+
+#define GROMIT_LOG(data, category, level, ...)				\
+  do {									\
+    if ((data)->log_levels[category] >= (level))			\
+      log_write (category, level, __VA_ARGS__);				\
+  } while (0)
+
+#define GROMIT_INFO(data, category, ...)  GROMIT_LOG (data, category, GROMIT_LOG_INFO, __VA_ARGS__)
+#define GROMIT_DEBUG(data, category, ...) GROMIT_LOG (data, category, GROMIT_LOG_DEBUG, __VA_ARGS__)
+#ifdef GROMIT_TRACE_LOG
+#define GROMIT_TRACE(data, category, ...) GROMIT_LOG (data, category, GROMIT_LOG_TRACE, __VA_ARGS__)
+#else
+#define GROMIT_TRACE(data, category, ...) do { } while (0)
+#endif
+
+/* Start and stop the thread writing messages out. */
+void log_init (void);
+void log_shutdown (void);
+
+void log_write (GromitLogCategory category, GromitLogLevel level, const gchar *format, ...) G_GNUC_PRINTF (3, 4);
+
+/* Raise all categories to at least level. */
+void log_set_all (guint8 *levels, GromitLogLevel level);
+/*
+  Set levels from a comma separated list of category[:level], where
+  category may be "all" and level defaults to debug.
+*/
+gboolean log_parse (guint8 *levels, const gchar *spec);
+
+#endif
@@ -23,11 +23,23 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <signal.h>
+#include <glib-unix.h>
 
 #include "callbacks.h"
 #include "config.h"
 #include "input.h"
 #include "main.h"
+#include "shape.h"
+#include "drawing.h"
+#include "tiles.h"
+#include "journal.h"
+#include "pool.h"
+#include "sampler.h"
+#include "latency.h"
+#include "trace.h"
+#include "profile.h"
+#include "tools.h"
 #include "build-config.h"
 
 #include "paint_cursor.xpm"
@@ -40,7 +52,9 @@ GromitPaintContext *paint_context_new (GromitData *data,
 				       guint arrowsize,
                GromitArrowPosition arrowposition,
 				       guint minwidth,
-				       guint maxwidth)
+				       guint maxwidth,
+				       guint smooth,
+				       guint predict)
 {
   GromitPaintContext *context;
 
@@ -52,27 +66,28 @@ GromitPaintContext *paint_context_new (GromitData *data,
   context->arrowposition = arrowposition;
   context->minwidth = minwidth;
   context->maxwidth = maxwidth;
+  context->smooth = smooth;
+  context->predict = predict;
   context->paint_color = paint_color;
-  context->start_arrow_painted = FALSE;
 
-  context->paint_ctx = cairo_create (data->backbuffer);
+  return context;
+}
 
-  gdk_cairo_set_source_rgba(context->paint_ctx, paint_color);
-  if(!data->composited)
-    cairo_set_antialias(context->paint_ctx, CAIRO_ANTIALIAS_NONE);
-  cairo_set_line_width(context->paint_ctx, width);
-  cairo_set_line_cap(context->paint_ctx, CAIRO_LINE_CAP_ROUND);
-  cairo_set_line_join(context->paint_ctx, CAIRO_LINE_JOIN_ROUND);
 
-  if (type == GROMIT_ERASER)
-    cairo_set_operator(context->paint_ctx, CAIRO_OPERATOR_CLEAR);
-  else
-    if (type == GROMIT_RECOLOR)
-      cairo_set_operator(context->paint_ctx, CAIRO_OPERATOR_ATOP);
-    else
-      cairo_set_operator(context->paint_ctx, CAIRO_OPERATOR_OVER);
+/* The area covered by monitors, which can be less than the screen size. */
+cairo_region_t *monitor_region_new (GromitData *data)
+{
+  cairo_region_t *region = cairo_region_create ();
+  gint i;
 
-  return context;
+  for (i = 0; i < gdk_screen_get_n_monitors (data->screen); i++)
+    {
+      GdkRectangle rect;
+      gdk_screen_get_monitor_geometry (data->screen, i, &rect);
+      cairo_region_union_rectangle (region, &rect);
+    }
+
+  return region;
 }
 
 
@@ -103,13 +118,14 @@ void paint_context_print (gchar *name,
   g_printerr ("maxwidth: %u, ", context->maxwidth);
   g_printerr ("arrowsize: %.2f, ", context->arrowsize);
   g_printerr ("arrowposition: %u, ", context->arrowposition);
+  g_printerr ("smooth: %u, ", context->smooth);
+  g_printerr ("predict: %u, ", context->predict);
   g_printerr ("color: %s\n", gdk_rgba_to_string(context->paint_color));
 }
 
 
 void paint_context_free (GromitPaintContext *context)
 {
-  cairo_destroy(context->paint_ctx);
   g_free (context);
 }
 
@@ -132,8 +148,7 @@ void hide_window (GromitData *data)
       release_grab (data, NULL); /* release all */
       gtk_widget_hide (data->win);
 
-      if(data->debug)
-        g_printerr ("DEBUG: Hiding window.\n");
+      GROMIT_DEBUG (data, GROMIT_LOG_GRAB, "Hiding window.");
     }
 }
 
@@ -156,8 +171,7 @@ void show_window (GromitData *data)
           if(devdata->was_grabbed)
             acquire_grab (data, devdata->device);
         }
-      if(data->debug)
-        g_printerr ("DEBUG: Showing window.\n");
+      GROMIT_DEBUG (data, GROMIT_LOG_GRAB, "Showing window.");
     }
   gdk_window_raise (gtk_widget_get_window(data->win));
 }
@@ -176,30 +190,26 @@ void toggle_visibility (GromitData *data)
 
 void clear_screen (GromitData *data)
 {
-  cairo_t *cr = cairo_create(data->backbuffer);
-  cairo_set_source_rgba(cr, 0, 0, 0, 0);
-  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
-  cairo_paint (cr);
-  cairo_destroy(cr);
+  /* strokes still queued for the next frame belong before the clear */
+  flush_all_pending(data);
+  journal_add_clear(data);
+  tiled_surface_clear(data->backbuffer);
 
   GdkRectangle rect = {0, 0, data->width, data->height};
   gdk_window_invalidate_rect(gtk_widget_get_window(data->win), &rect, 0);
 
   if(!data->composited)
     {
-      cairo_region_t* r = gdk_cairo_region_create_from_surface(data->backbuffer);
-      gtk_widget_shape_combine_region(data->win, r);
-      cairo_region_destroy(r);
+      shape_clear(data);
       // try to set transparent for input
-      r =  cairo_region_create();
+      cairo_region_t* r =  cairo_region_create();
       gtk_widget_input_shape_combine_region(data->win, r);
       cairo_region_destroy(r);
     }
 
   data->painted = 0;
 
-  if(data->debug)
-    g_printerr ("DEBUG: Cleared screen.\n");
+  GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "Cleared screen.");
 }
 
 
@@ -215,11 +225,15 @@ gint reshape (gpointer user_data)
         }
       else
         {
-	  cairo_region_t* r = gdk_cairo_region_create_from_surface(data->backbuffer);
-	  gtk_widget_shape_combine_region(data->win, r);
-	  cairo_region_destroy(r);
+	  gint64 start = g_get_monotonic_time();
+
+	  GROMIT_PROFILE_BEGIN(data, "shape_update");
+	  shape_update(data);
+	  GROMIT_PROFILE_END(data, "shape_update", NULL, -1);
+	  data->counters.reshapes++;
+	  data->counters.reshape_time += g_get_monotonic_time() - start;
 	  // try to set transparent for input
-	  r =  cairo_region_create();
+	  cairo_region_t* r =  cairo_region_create();
 	  gtk_widget_input_shape_combine_region(data->win, r);
 	  cairo_region_destroy(r);
 
@@ -242,13 +256,7 @@ void select_tool (GromitData *data,
 		  GdkDevice *slave_device,
 		  guint state)
 {
-  guint buttons = 0, modifier = 0, slave_len = 0, len = 0, default_len = 0;
-  guint req_buttons = 0, req_modifier = 0;
-  guint i, j, success = 0;
   GromitPaintContext *context = NULL;
-  guchar *slave_name;
-  guchar *name;
-  guchar *default_name;
 
   /* get the data for this device */
   GromitDeviceData *devdata = g_hash_table_lookup(data->devdatatable, device);
@@ -257,158 +265,38 @@ void select_tool (GromitData *data,
       data->extra_modifier_state == devdata->extra_modifier_state &&
       devdata->lastslave == slave_device)
   {
-    if (data->debug)
-      g_printerr("DEBUG: select_tool skipped (same context)\n");
+    GROMIT_TRACE (data, GROMIT_LOG_TOOL, "select_tool skipped (same context)");
     return;
   }
 
+  GROMIT_PROFILE_BEGIN (data, "select_tool");
+
   if (device)
     {
-      slave_len = strlen (gdk_device_get_name(slave_device));
-      slave_name = (guchar*) g_strndup (gdk_device_get_name(slave_device), slave_len + 3);
-      len = strlen (gdk_device_get_name(device));
-      name = (guchar*) g_strndup (gdk_device_get_name(device), len + 3);
-      default_len = strlen(DEFAULT_DEVICE_NAME);
-      default_name = (guchar*) g_strndup (DEFAULT_DEVICE_NAME, default_len + 3);
-
-
-      /* Extract Button/Modifiers from state (see GdkModifierType) */
-      req_buttons = (state >> 8) & 31;
-
-      req_modifier = (state >> 1) & 7;
-      if (state & GDK_SHIFT_MASK) req_modifier |= 1;
-
-      slave_name [slave_len] = 124;
-      slave_name [slave_len+3] = 0;
-      name [len] = 124;
-      name [len+3] = 0;
-      default_name [default_len] = 124;
-      default_name [default_len+3] = 0;
-
-      /*
-	Iterate i up until <= req_buttons.
-	For each i, find out if bits of i are _all_ in `req_buttons`.
-	- If yes, lookup if there is tool and select if there is.
-	- If no, try next i, no tool lookup.
-      */
-      context = NULL;
-      i=-1;
-      do
-        {
-          i++;
-
-	  /*
-	    For all i > 0, find out if _all_ bits representing the iterator 'i'
-	    are present in req_buttons as well. If not (none or only some are),
-	    then go on.
-	    The condition i==0 handles the config cases where no button is given.
-	  */
-	  buttons = i & req_buttons;
-	  if(i > 0 && (buttons == 0 || buttons != i))
-	      continue;
-
-          j=-1;
-          do
-            {
-              j++;
-              modifier = req_modifier & ((1 << j)-1);
-              slave_name [slave_len+1] = buttons + 64;
-              slave_name [slave_len+2] = modifier + 48;
-              name [len+1] = buttons + 64;
-              name [len+2] = modifier + 48;
-              default_name [default_len+1] = buttons + 64;
-              default_name [default_len+2] = modifier + 48;
-
-	            if(data->debug)
-                g_printerr("DEBUG: select_tool looking up context for '%s' attached to '%s'\n", slave_name, name);
-
-              context = g_hash_table_lookup (data->tool_config, slave_name);
-              if(context) {
-                  if(data->debug)
-                    g_printerr("DEBUG: select_tool set context for '%s'\n", slave_name);
-                  devdata->cur_context = context;
-                  success = 1;
-              }
-              else /* try master name */
-              if ((context = g_hash_table_lookup (data->tool_config, name)))
-                {
-                  if(data->debug)
-                    g_printerr("DEBUG: select_tool set context for '%s'\n", name);
-                  devdata->cur_context = context;
-                  success = 1;
-                }
-              else /* try default_name */
-                if((context = g_hash_table_lookup (data->tool_config, default_name)))
-                  {
-                    if(data->debug)
-                      g_printerr("DEBUG: select_tool set default context '%s' for '%s'\n", default_name, name);
-                    devdata->cur_context = context;
-                    success = 1;
-                  }
-
-            }
-          while (j<=3 && req_modifier >= (1u << j));
-        }
-      while (i < req_buttons);
-
-      // Extra modifier  //TODO remove code duplication
-      if (!req_modifier && data->extra_modifier_state)
-      {
-        buttons = 0;
-        modifier = 8;
-        slave_name[slave_len + 1] = buttons + 64;
-        slave_name[slave_len + 2] = modifier + 48;
-        name[len + 1] = buttons + 64;
-        name[len + 2] = modifier + 48;
-        default_name[default_len + 1] = buttons + 64;
-        default_name[default_len + 2] = modifier + 48;
-
-        if (data->debug)
-          g_printerr("DEBUG: extra modifier select_tool looking up context for '%s' attached to '%s'\n", slave_name, name);
-
-        context = g_hash_table_lookup(data->tool_config, slave_name);
-        if (context)
-        {
-          if (data->debug)
-            g_printerr("DEBUG: extra modifier select_tool set context for '%s'\n", slave_name);
-          devdata->cur_context = context;
-          success = 1;
-        }
-        else /* try master name */
-            if ((context = g_hash_table_lookup(data->tool_config, name)))
-        {
-          if (data->debug)
-            g_printerr("DEBUG: extra modifier select_tool set context for '%s'\n", name);
-          devdata->cur_context = context;
-          success = 1;
-        }
-        else /* try default_name */
-            if ((context = g_hash_table_lookup(data->tool_config, default_name)))
-        {
-          if (data->debug)
-            g_printerr("DEBUG: extra modifier select_tool set default context '%s' for '%s'\n", default_name, name);
-          devdata->cur_context = context;
-          success = 1;
-        }
-      }
-
-      g_free (name);
-      g_free (default_name);
-
-      if (!success)
+      context = tool_table_lookup (tool_table_get (data, devdata, slave_device),
+				   state, data->extra_modifier_state);
+
+      if (context)
+	{
+	  GROMIT_TRACE (data, GROMIT_LOG_TOOL, "select_tool set context %p for state %u",
+		       (void *) context, state);
+	  devdata->cur_context = context;
+	}
+      else
         {
           if (gdk_device_get_source(device) == GDK_SOURCE_ERASER)
             devdata->cur_context = data->default_eraser;
           else
             devdata->cur_context = data->default_pen;
 
-	  if(data->debug)
-	      g_printerr("DEBUG: select_tool set fallback context for '%s'\n", name);
+	  GROMIT_DEBUG (data, GROMIT_LOG_TOOL, "select_tool set fallback context for '%s'", gdk_device_get_name(device));
         }
     }
   else
     g_printerr ("ERROR: select_tool attempted to select nonexistent device!\n");
 
+  device_paint_ctx_update (data, devdata);
+
   GdkCursor *cursor;
   if(devdata->cur_context && devdata->cur_context->type == GROMIT_ERASER)
     cursor = data->erase_cursor;
@@ -416,8 +304,7 @@ void select_tool (GromitData *data,
     cursor = data->paint_cursor;
 
 
-  if(data->debug)
-    g_printerr("DEBUG: select_tool setting cursor %p\n",cursor);
+  GROMIT_TRACE (data, GROMIT_LOG_TOOL, "select_tool setting cursor %p",cursor);
 
 
   //FIXME!  Should be:
@@ -434,101 +321,32 @@ void select_tool (GromitData *data,
   devdata->state = state;
   devdata->lastslave = slave_device;
   devdata->extra_modifier_state = data->extra_modifier_state;
-}
-
-
-
-void snap_undo_state (GromitData *data)
-{
-  if(data->debug)
-    g_printerr ("DEBUG: Snapping undo buffer %d.\n", data->undo_head);
-
-  copy_surface(data->undobuffer[data->undo_head], data->backbuffer);
-
-  // Increment head position
-  data->undo_head++;
-  if(data->undo_head >= GROMIT_MAX_UNDO)
-    data->undo_head -= GROMIT_MAX_UNDO;
-  data->undo_depth++;
-  // See if we ran out of undo levels with oldest undo overwritten
-  if(data->undo_depth > GROMIT_MAX_UNDO)
-    data->undo_depth = GROMIT_MAX_UNDO;
-  // Invalidate any redo from this position
-  data->redo_depth = 0;
-}
-
-
-
-void copy_surface (cairo_surface_t *dst, cairo_surface_t *src)
-{
-  cairo_t *cr = cairo_create(dst);
-  cairo_set_source_surface(cr, src, 0, 0);
-  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
-  cairo_paint (cr);
-  cairo_destroy(cr);
-}
-
-
 
-void swap_surfaces (cairo_surface_t *a, cairo_surface_t *b)
-{
-  int width = cairo_image_surface_get_width(a);
-  int height = cairo_image_surface_get_height(a);
-  cairo_surface_t *temp = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
-  copy_surface(temp, a);
-  copy_surface(a, b);
-  copy_surface(b, temp);
-  cairo_surface_destroy(temp);
+  GROMIT_PROFILE_END (data, "select_tool", device, -1);
 }
 
 
 
 void undo_drawing (GromitData *data)
 {
-  /* Swap undobuffer[head-1]->backbuffer */
-  if(data->undo_depth <= 0)
+  if (!journal_undo(data))
     return;
-  data->undo_depth--;
-  data->redo_depth++;
-  if(data->redo_depth > GROMIT_MAX_UNDO)
-    data->redo_depth -= GROMIT_MAX_UNDO;
-  data->undo_head--;
-  if(data->undo_head < 0)
-    data->undo_head += GROMIT_MAX_UNDO;
-
-  swap_surfaces(data->backbuffer, data->undobuffer[data->undo_head]);
-
-  GdkRectangle rect = {0, 0, data->width, data->height};
-  gdk_window_invalidate_rect(gtk_widget_get_window(data->win), &rect, 0);
 
   data->modified = 1;
 
-  if(data->debug)
-    g_printerr ("DEBUG: Undo drawing %d.\n", data->undo_head);
+  GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "Undo drawing.");
 }
 
 
 
 void redo_drawing (GromitData *data)
 {
-  if(data->redo_depth <= 0)
+  if (!journal_redo(data))
     return;
 
-  swap_surfaces(data->backbuffer, data->undobuffer[data->undo_head]);
-
-  data->redo_depth--;
-  data->undo_depth++;
-  data->undo_head++;
-  if(data->undo_head >= GROMIT_MAX_UNDO)
-    data->undo_head -= GROMIT_MAX_UNDO;
-
-  GdkRectangle rect = {0, 0, data->width, data->height};
-  gdk_window_invalidate_rect(gtk_widget_get_window(data->win), &rect, 0);
-
   data->modified = 1;
 
-  if(data->debug)
-    g_printerr("DEBUG: Redo drawing.\n");
+  GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "Redo drawing.");
 }
 
 
@@ -546,6 +364,8 @@ void main_do_event(GdkEventAny *event,
   guint keycode = ((GdkEventKey *)event)->hardware_keycode;
   gboolean keycode_handled = FALSE;
 
+  GROMIT_PROFILE_BEGIN(data, "main_do_event");
+
   if (event->type == GDK_KEY_PRESS)
   {
     keycode_handled = TRUE;
@@ -590,6 +410,15 @@ void main_do_event(GdkEventAny *event,
   }
 
   gtk_main_do_event((GdkEvent *)event);
+
+  GROMIT_PROFILE_END(data, "main_do_event", gdk_event_get_device((GdkEvent *)event), -1);
+}
+
+/* SIGUSR1 prints the latency histograms, see latency.h */
+static gboolean on_dump_latency (gpointer user_data)
+{
+  latency_dump ((GromitData *) user_data);
+  return G_SOURCE_CONTINUE;
 }
 
 void setup_main_app (GromitData *data, int argc, char ** argv)
@@ -687,21 +516,15 @@ void setup_main_app (GromitData *data, int argc, char ** argv)
     DRAWING AREA
   */
   /* SHAPE SURFACE*/
-  cairo_surface_destroy(data->backbuffer);
-  data->backbuffer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, data->width, data->height);
+  data->drawing_ops = &window_drawing_ops;
+  surface_pool_resize(data);
+  data->backbuffer = surface_pool_get(data);
+  data->preview = surface_pool_get(data);
 
   /*
     UNDO STATE
   */
-  data->undo_head = 0;
-  data->undo_depth = 0;
-  data->redo_depth = 0;
-  int i;
-  for (i = 0; i < GROMIT_MAX_UNDO; i++)
-    {
-      cairo_surface_destroy(data->undobuffer[i]);
-      data->undobuffer[i] = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, data->width, data->height);
-    }
+  journal_init(data);
 
 
 
@@ -742,11 +565,7 @@ void setup_main_app (GromitData *data, int argc, char ** argv)
 
 
   if(!data->composited) // set initial shape
-    {
-      cairo_region_t* r = gdk_cairo_region_create_from_surface(data->backbuffer);
-      gtk_widget_shape_combine_region(data->win, r);
-      cairo_region_destroy(r);
-    }
+    shape_rebuild(data);
 
 
   /* reset settings from client setup */
@@ -763,6 +582,7 @@ void setup_main_app (GromitData *data, int argc, char ** argv)
   gtk_selection_add_target (data->win, GA_CONTROL, GA_RELOAD, 7);
   gtk_selection_add_target (data->win, GA_CONTROL, GA_UNDO, 8);
   gtk_selection_add_target (data->win, GA_CONTROL, GA_REDO, 9);
+  gtk_selection_add_target (data->win, GA_CONTROL, GA_STATS, 10);
 
 
 
@@ -805,6 +625,9 @@ void setup_main_app (GromitData *data, int argc, char ** argv)
   */
   data->devdatatable = g_hash_table_new(NULL, NULL);
   setup_input_devices (data);
+  data->sampler = sampler_new (data);
+
+  g_unix_signal_add (SIGUSR1, on_dump_latency, data);
 
 
 
@@ -818,18 +641,25 @@ void setup_main_app (GromitData *data, int argc, char ** argv)
   data->modified = 0;
 
   data->default_pen = paint_context_new (data, GROMIT_PEN,
-					 data->red, 7, 0, GROMIT_ARROW_AT_NONE, 1, G_MAXUINT);
+					 data->red, 7, 0, GROMIT_ARROW_AT_NONE, 1, G_MAXUINT, 0, 0);
   data->default_eraser = paint_context_new (data, GROMIT_ERASER,
-					    data->red, 75, 0, GROMIT_ARROW_AT_NONE, 1, G_MAXUINT);
+					    data->red, 75, 0, GROMIT_ARROW_AT_NONE, 1, G_MAXUINT, 0, 0);
 
 
 
   gdk_event_handler_set ((GdkEventFunc) main_do_event, data, NULL);
   gtk_key_snooper_install (snoop_key_press, data);
 
-  if (activate)
+  if (activate || data->replay_file)
     acquire_grab (data, NULL); /* grab all */
 
+  if (data->profile_file)
+    profile_start (data, data->profile_file);
+  if (data->record_file)
+    trace_record_start (data, data->record_file);
+  if (data->replay_file)
+    trace_replay_start (data, data->replay_file, data->replay_fast);
+
   /*
      TRAY ICON
   */
@@ -1014,6 +844,7 @@ int main_client (int argc, char **argv, GromitData *data)
            strcmp (arg, "--debug") == 0)
          {
            data->debug = 1;
+           log_set_all (data->log_levels, GROMIT_LOG_DEBUG);
          }
        else if (strcmp (arg, "-t") == 0 ||
            strcmp (arg, "--toggle") == 0)
@@ -1081,6 +912,10 @@ int main_client (int argc, char **argv, GromitData *data)
          {
            action = GA_REDO;
          }
+       else if (strcmp (arg, "--stats") == 0)
+         {
+           action = GA_STATS;
+         }
        else
          {
            g_printerr ("Unknown Option to control a running Gromit-MPX process: \"%s\"\n", arg);
@@ -1115,6 +950,7 @@ int main (int argc, char **argv)
 
   gtk_init (&argc, &argv);
   data = g_malloc0(sizeof (GromitData));
+  log_init ();
 
   /*
      init basic stuff
@@ -1126,6 +962,7 @@ int main (int argc, char **argv)
   data->root = gdk_screen_get_root_window (data->screen);
   data->width = gdk_screen_get_width (data->screen);
   data->height = gdk_screen_get_height (data->screen);
+  data->monitors = monitor_region_new (data);
   data->opacity = DEFAULT_OPACITY;
 
   /*
@@ -1176,13 +1013,24 @@ int main (int argc, char **argv)
   gtk_main ();  /* Wait for the response */
 
   if (data->client)
-    return main_client (argc, argv, data);
+    {
+      gint ret = main_client (argc, argv, data);
+      log_shutdown ();
+      return ret;
+    }
 
   /* Main application */
   setup_main_app (data, argc, argv);
   gtk_main ();
+  sampler_free(data->sampler);
+  trace_record_stop(data);
+  profile_stop(data);
+  if (data->log_levels[GROMIT_LOG_INPUT] >= GROMIT_LOG_DEBUG)
+    latency_dump(data);
   shutdown_input_devices(data);
+  latency_free(data->latency);
   write_keyfile(data); // save keyfile config
+  log_shutdown();
   g_free (data);
   return 0;
 }
@@ -24,6 +24,7 @@
 #define GROMIT_MPX_MAIN_H
 
 #include "build-config.h"
+#include "log.h"
 
 #include <glib.h>
 #include <glib/gi18n.h>
@@ -41,6 +42,9 @@
 
 #define GROMIT_WINDOW_EVENTS ( GROMIT_MOUSE_EVENTS | GDK_EXPOSURE_MASK)
 
+/* Spare screen-sized surfaces kept around, see pool.h */
+#define GROMIT_SURFACE_POOL_SIZE 4
+
 /* Atoms used to control Gromit */
 #define GA_CONTROL    gdk_atom_intern ("Gromit/control", FALSE)
 #define GA_STATUS     gdk_atom_intern ("Gromit/status", FALSE)
@@ -53,14 +57,13 @@
 #define GA_RELOAD     gdk_atom_intern ("Gromit/reload", FALSE)
 #define GA_UNDO       gdk_atom_intern ("Gromit/undo", FALSE)
 #define GA_REDO       gdk_atom_intern ("Gromit/redo", FALSE)
+#define GA_STATS      gdk_atom_intern ("Gromit/stats", FALSE)
 
 #define GA_DATA           gdk_atom_intern("Gromit/data", FALSE)
 #define GA_TOGGLEDATA     gdk_atom_intern("Gromit/toggledata", FALSE)
 #define GA_ACTIVATEDATA   gdk_atom_intern("Gromit/activatedata", FALSE)
 #define GA_DEACTIVATEDATA gdk_atom_intern("Gromit/deactivatedata", FALSE)
 
-#define GROMIT_MAX_UNDO 4
-
 typedef enum
 {
   GROMIT_PEN,
@@ -79,6 +82,17 @@ typedef enum
   GROMIT_ARROW_AT_BOTH = GROMIT_ARROW_AT_START | GROMIT_ARROW_AT_END
 } GromitArrowPosition;
 
+/*
+  How pen motion reaches us, from most to least precise. Chosen at run
+  time from the measured render cost, see on_frame_tick().
+*/
+typedef enum
+{
+  GROMIT_COMPRESS_NONE,     /* every motion event, no history */
+  GROMIT_COMPRESS_CATCHUP,  /* compressed events, gaps filled from history */
+  GROMIT_COMPRESS_FULL      /* compressed events only */
+} GromitCompression;
+
 typedef enum
 {
   GROMIT_COLOR_BLACK,
@@ -90,6 +104,24 @@ typedef enum
   GROMIT_BASIC_COLOR_COUNT
 } GromitPaintColor;
 
+/* defined in journal.c */
+typedef struct _GromitStroke GromitStroke;
+typedef struct _GromitJournal GromitJournal;
+/* defined in smooth.c */
+typedef struct _GromitSmoother GromitSmoother;
+/* defined in predict.c */
+typedef struct _GromitPredictor GromitPredictor;
+/* defined in sampler.c */
+typedef struct _GromitSampler GromitSampler;
+/* defined in latency.h */
+typedef struct _GromitLatency GromitLatency;
+/* defined in drawing.h */
+typedef struct _GromitDrawingOps GromitDrawingOps;
+/* defined in trace.c */
+typedef struct _GromitTrace GromitTrace;
+/* defined in profile.c */
+typedef struct _GromitProfile GromitProfile;
+
 typedef struct
 {
   GromitPaintType     type;
@@ -98,18 +130,38 @@ typedef struct
   GromitArrowPosition arrowposition;
   guint               minwidth;
   guint               maxwidth;
+  guint               smooth;
+  guint               predict;
   GdkRGBA             *paint_color;
-  cairo_t             *paint_ctx;
   gdouble             pressure;
-  gboolean            start_arrow_painted;
 } GromitPaintContext;
 
+/* Running totals, as reported by gromit-mpx --stats */
+typedef struct
+{
+  guint64 events;              /* button and motion events handled */
+  guint64 segments;            /* freehand segments drawn */
+  guint64 invalidated_pixels;  /* area invalidated on the window, overlaps counted again */
+  guint64 reshapes;            /* window shape updates */
+  gint64  reshape_time;        /* spent in them, in microseconds */
+} GromitCounters;
+
+/*
+  The tool for every combination of buttons, modifiers and extra
+  modifier, as resolved from the config for one device, see select_tool().
+*/
+typedef struct
+{
+  GromitPaintContext *tools[32][8][2];
+  guint               generation;
+} GromitToolTable;
+
 typedef struct
 {
   gdouble      lastx;
   gdouble      lasty;
   guint32      motion_time;
-  GList*       coordlist;
+  GArray*      coordlist;
   GdkDevice*   device;
   guint        index;
   guint        state;
@@ -118,6 +170,28 @@ typedef struct
   gboolean     is_grabbed;
   gboolean     was_grabbed;
   GdkDevice*   lastslave;
+  GromitStroke *stroke;
+  gboolean     has_preview;
+  GdkRectangle preview_rect;
+  GArray      *pending;
+  GromitSmoother *smoother;
+  GromitPredictor *predictor;
+  gboolean     has_prediction;
+  GdkRectangle prediction_rect;
+  GArray      *samples;
+  GHashTable  *tool_tables;
+  /* stroke state, kept per device so several pointers can draw at once */
+  cairo_t     *paint_ctx;
+  guint        maxwidth;
+  gboolean     start_arrow_painted;
+  guint        stroke_points;
+  guint        stroke_segments;
+  gint64       stroke_paint_time;
+  /* see latency.h */
+  GromitLatency *latency;
+  guint32      latency_pending;
+  guint32      latency_drawn;
+  gboolean     latency_report;
 } GromitDeviceData;
 
 typedef struct
@@ -163,30 +237,69 @@ typedef struct
 
   GHashTable  *tool_config;
 
+  const GromitDrawingOps *drawing_ops;
+
   cairo_surface_t *backbuffer;
+  cairo_surface_t *preview;
+
+  cairo_surface_t *surface_pool[GROMIT_SURFACE_POOL_SIZE];
+  guint            surface_pool_len;
+  guint            surface_pool_hits;
+  guint            surface_pool_misses;
+
+  guint            tick_id;
+  cairo_region_t  *frame_damage;
+  guint            frame_count;
+  guint            frame_segments;
+  gint64           frame_stats_start;
+
+  gint64            render_cost;
+  GromitCompression compression;
+  gboolean          compression_adaptive;
+  gint64            compression_since;
+
+  cairo_region_t  *shape_region;
+  cairo_region_t  *shape_damage;
+
+  cairo_region_t  *monitors;
+
+  GromitSampler   *sampler;
+
+  GromitLatency   *latency;
+  GromitCounters   counters;
+
+  /* see trace.h */
+  gchar           *record_file;
+  gchar           *replay_file;
+  gboolean         replay_fast;
+  GromitTrace     *recorder;
+  GromitTrace     *replayer;
+
+  /* see profile.h */
+  gchar           *profile_file;
+  GromitProfile   *profile;
+
+  guint            tool_generation;
 
   GHashTable  *devdatatable;
 
   guint        timeout_id;
   guint        modified;
   guint        delayed;
-  guint        maxwidth;
   guint        width;
   guint        height;
   guint        client;
   guint        painted;
   gboolean     hidden;
   gboolean     debug;
+  guint8       log_levels[GROMIT_LOG_CATEGORIES];
 
   gchar       *clientdata;
 
-  cairo_surface_t *undobuffer[GROMIT_MAX_UNDO];
-  gint            undo_head, undo_depth, redo_depth;
+  GromitJournal *journal;
 
   gboolean show_intro_on_startup;
 
-  cairo_surface_t *motionbuffer;
-
 } GromitData;
 
 
@@ -198,9 +311,6 @@ void parse_print_help (gpointer key, gpointer value, gpointer user_data);
 
 void select_tool (GromitData *data, GdkDevice *device, GdkDevice *slave_device, guint state);
 
-void copy_surface (cairo_surface_t *dst, cairo_surface_t *src);
-void swap_surfaces (cairo_surface_t *a, cairo_surface_t *b);
-void snap_undo_state (GromitData *data);
 void undo_drawing (GromitData *data);
 void redo_drawing (GromitData *data);
 
@@ -208,9 +318,11 @@ void clear_screen (GromitData *data);
 
 GromitPaintContext *paint_context_new (GromitData *data, GromitPaintType type,
 				       GdkRGBA *fg_color, guint width, guint arrowsize, GromitArrowPosition arrowposition,
-                                       guint minwidth, guint maxwidth);
+                                       guint minwidth, guint maxwidth, guint smooth, guint predict);
 void paint_context_free (GromitPaintContext *context);
 
+cairo_region_t *monitor_region_new (GromitData *data);
+
 void indicate_active(GromitData *data, gboolean YESNO);
 
 guint find_keycode(GdkDisplay *display, gchar *keyname);
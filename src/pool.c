@@ -0,0 +1,77 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "pool.h"
+#include "tiles.h"
+
+/* how many surfaces a resize puts into the pool right away */
+#define GROMIT_SURFACE_POOL_PREFILL 2
+
+
+cairo_surface_t *surface_pool_get (GromitData *data)
+{
+  cairo_surface_t *surface;
+
+  if (data->surface_pool_len > 0)
+    {
+      surface = data->surface_pool[--data->surface_pool_len];
+      data->surface_pool_hits++;
+    }
+  else
+    {
+      surface = tiled_surface_create (data->width, data->height);
+      data->surface_pool_misses++;
+    }
+
+  GROMIT_TRACE (data, GROMIT_LOG_DRAW, "Surface pool: %u hits, %u misses, %u spare.",
+		data->surface_pool_hits, data->surface_pool_misses, data->surface_pool_len);
+
+  return surface;
+}
+
+
+void surface_pool_put (GromitData *data, cairo_surface_t *surface)
+{
+  if (data->surface_pool_len < GROMIT_SURFACE_POOL_SIZE
+      && cairo_image_surface_get_width (surface) == (gint) data->width
+      && cairo_image_surface_get_height (surface) == (gint) data->height)
+    {
+      tiled_surface_clear (surface);
+      data->surface_pool[data->surface_pool_len++] = surface;
+    }
+  else
+    cairo_surface_destroy (surface);
+}
+
+
+void surface_pool_resize (GromitData *data)
+{
+  while (data->surface_pool_len > 0)
+    cairo_surface_destroy (data->surface_pool[--data->surface_pool_len]);
+
+  while (data->surface_pool_len < GROMIT_SURFACE_POOL_PREFILL)
+    data->surface_pool[data->surface_pool_len++] = tiled_surface_create (data->width, data->height);
+
+  GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "Surface pool refilled with %u surfaces of %u x %u.",
+		data->surface_pool_len, data->width, data->height);
+}
@@ -0,0 +1,45 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+/*
+  A few spare screen-sized tiled surfaces, so that clearing the screen
+  and the like do not have to map fresh memory every time.
+  Surfaces handed back are cleared and kept as long as they match the
+  screen size; surface_pool_resize() follows a change of it.
+*/
+
+#include "main.h"
+
+/* Get a blank surface of the current screen size. */
+cairo_surface_t *surface_pool_get (GromitData *data);
+
+/* Hand a surface back, it is destroyed if the pool has no use for it. */
+void surface_pool_put (GromitData *data, cairo_surface_t *surface);
+
+/* Drop the spare surfaces and refill the pool at the current screen size. */
+void surface_pool_resize (GromitData *data);
+
+#endif
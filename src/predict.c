@@ -0,0 +1,164 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <math.h>
+
+#include "predict.h"
+#include "drawing.h"
+
+/* points further apart than this in time mean the pen stopped */
+#define GROMIT_PREDICT_MAX_GAP 50
+
+struct _GromitPredictor
+{
+  /* the model of the last prediction, in pixels and milliseconds */
+  gboolean valid;
+  guint32  time;
+  guint    ahead;
+  gdouble  x, y;
+  gdouble  vx, vy;
+  gdouble  ax, ay;
+
+  gdouble  error_sum;
+  gdouble  error_max;
+  guint    error_n;
+};
+
+
+GromitPredictor *predictor_new (void)
+{
+  return g_malloc0 (sizeof (GromitPredictor));
+}
+
+
+void predictor_free (GromitPredictor *predictor)
+{
+  g_free (predictor);
+}
+
+
+static void evaluate (GromitPredictor *p, gdouble t, gdouble *x, gdouble *y)
+{
+  gdouble dx = p->vx * t + 0.5 * p->ax * t * t;
+  gdouble dy = p->vy * t + 0.5 * p->ay * t * t;
+  /* noisy acceleration must not throw the guess further than twice the current speed would */
+  gdouble limit = 2 * hypot (p->vx, p->vy) * t;
+  gdouble d = hypot (dx, dy);
+
+  if (d > limit && d > 0)
+    {
+      dx *= limit / d;
+      dy *= limit / d;
+    }
+
+  *x = p->x + dx;
+  *y = p->y + dy;
+}
+
+
+/* Index of the newest point before i that is older than point i, or -1. */
+static gint previous_point (GArray *coords, gint i)
+{
+  guint32 time = g_array_index (coords, GromitStrokeCoordinate, i).time;
+
+  while (--i >= 0)
+    if (g_array_index (coords, GromitStrokeCoordinate, i).time != time)
+      return i;
+
+  return -1;
+}
+
+
+gboolean predictor_update (GromitPredictor *predictor, GArray *coords, guint ahead, gint *x, gint *y)
+{
+  GromitStrokeCoordinate *p0, *p1, *p2;
+  gint i1, i0;
+  gdouble dt1, dt2, px, py;
+
+  if (!coords || coords->len < 2)
+    return FALSE;
+
+  p2 = &g_array_index (coords, GromitStrokeCoordinate, coords->len - 1);
+
+  /* score the last guess against where the pen really went */
+  if (predictor->valid && p2->time > predictor->time
+      && p2->time - predictor->time <= predictor->ahead)
+    {
+      gdouble error;
+      evaluate (predictor, p2->time - predictor->time, &px, &py);
+      error = hypot (px - p2->x, py - p2->y);
+      predictor->error_sum += error;
+      predictor->error_max = MAX (predictor->error_max, error);
+      predictor->error_n++;
+    }
+  predictor->valid = FALSE;
+
+  i1 = previous_point (coords, coords->len - 1);
+  if (i1 < 0)
+    return FALSE;
+  p1 = &g_array_index (coords, GromitStrokeCoordinate, i1);
+  dt2 = p2->time - p1->time;
+  if (dt2 > GROMIT_PREDICT_MAX_GAP)
+    return FALSE;
+
+  predictor->vx = (p2->x - p1->x) / dt2;
+  predictor->vy = (p2->y - p1->y) / dt2;
+  predictor->ax = predictor->ay = 0;
+
+  i0 = previous_point (coords, i1);
+  if (i0 >= 0)
+    {
+      p0 = &g_array_index (coords, GromitStrokeCoordinate, i0);
+      dt1 = p1->time - p0->time;
+      if (dt1 <= GROMIT_PREDICT_MAX_GAP)
+	{
+	  predictor->ax = (predictor->vx - (p1->x - p0->x) / dt1) / ((dt1 + dt2) / 2);
+	  predictor->ay = (predictor->vy - (p1->y - p0->y) / dt1) / ((dt1 + dt2) / 2);
+	}
+    }
+
+  predictor->valid = TRUE;
+  predictor->time = p2->time;
+  predictor->ahead = ahead;
+  predictor->x = p2->x;
+  predictor->y = p2->y;
+
+  evaluate (predictor, ahead, &px, &py);
+  *x = lround (px);
+  *y = lround (py);
+
+  return *x != p2->x || *y != p2->y;
+}
+
+
+void predictor_reset (GromitPredictor *predictor, gdouble *mean_error, gdouble *max_error, guint *n)
+{
+  *mean_error = predictor->error_n ? predictor->error_sum / predictor->error_n : 0;
+  *max_error = predictor->error_max;
+  *n = predictor->error_n;
+
+  predictor->valid = FALSE;
+  predictor->error_sum = 0;
+  predictor->error_max = 0;
+  predictor->error_n = 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef PREDICT_H
+#define PREDICT_H
+
+/*
+  Pen motion prediction.
+
+  The stroke is extrapolated a few milliseconds ahead from the velocity
+  and acceleration of its newest points, so that the ink can be drawn
+  to where the pen is about to be rather than where it was. Each new
+  point is also checked against the previous prediction, and the errors
+  are kept for the debug statistics.
+*/
+
+#include "main.h"
+
+GromitPredictor *predictor_new (void);
+void predictor_free (GromitPredictor *predictor);
+
+/*
+  Fit the newest points of coords, GromitStrokeCoordinates in drawing
+  order, and extrapolate ahead milliseconds past the last one. Returns
+  FALSE if the pen is not moving steadily enough to make a guess.
+*/
+gboolean predictor_update (GromitPredictor *predictor, GArray *coords, guint ahead, gint *x, gint *y);
+
+/* Forget the stroke, returning the error statistics of its predictions. */
+void predictor_reset (GromitPredictor *predictor, gdouble *mean_error, gdouble *max_error, guint *n);
+
+#endif
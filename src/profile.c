@@ -0,0 +1,123 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "profile.h"
+
+struct _GromitProfile
+{
+  FILE    *file;
+  gint     pid;
+  gboolean first;
+};
+
+
+gboolean profile_start (GromitData *data, const gchar *filename)
+{
+  GromitProfile *profile;
+  FILE *file = fopen (filename, "w");
+
+  if (!file)
+    {
+      g_printerr ("Could not write profile to %s\n", filename);
+      return FALSE;
+    }
+
+  profile = g_new0 (GromitProfile, 1);
+  profile->file = file;
+  profile->pid = getpid ();
+  profile->first = TRUE;
+  fputs ("[", file);
+
+  data->profile = profile;
+  return TRUE;
+}
+
+
+void profile_stop (GromitData *data)
+{
+  if (!data->profile)
+    return;
+
+  fputs ("\n]\n", data->profile->file);
+  fclose (data->profile->file);
+  g_free (data->profile);
+  data->profile = NULL;
+}
+
+
+/* Start an event, leaving it open for arguments. */
+static void event_open (GromitProfile *profile, const gchar *name, const gchar *phase)
+{
+  fprintf (profile->file, "%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":%d,\"tid\":1,\"ts\":%" G_GINT64_FORMAT,
+	   profile->first ? "" : ",", name, phase, profile->pid, g_get_monotonic_time ());
+  profile->first = FALSE;
+}
+
+
+void profile_begin (GromitData *data, const gchar *name)
+{
+  event_open (data->profile, name, "B");
+  fputs ("}", data->profile->file);
+}
+
+
+void profile_end (GromitData *data,
+		  const gchar *name,
+		  GdkDevice *device,
+		  gint points)
+{
+  FILE *file = data->profile->file;
+  const gchar *sep = "";
+
+  event_open (data->profile, name, "E");
+
+  if (!device && points < 0)
+    {
+      fputs ("}", file);
+      return;
+    }
+
+  fputs (",\"args\":{", file);
+  if (device)
+    {
+      const gchar *c;
+
+      /* device names are free form, keep the JSON valid */
+      fputs ("\"device\":\"", file);
+      for (c = gdk_device_get_name (device); c && *c; c++)
+	if (*c == '"' || *c == '\\')
+	  fprintf (file, "\\%c", *c);
+	else if ((guchar) *c < 0x20)
+	  fprintf (file, "\\u%04x", *c);
+	else
+	  fputc (*c, file);
+      fputs ("\"", file);
+      sep = ",";
+    }
+  if (points >= 0)
+    fprintf (file, "%s\"points\":%d", sep, points);
+  fputs ("}}", file);
+}
@@ -0,0 +1,59 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/*
+  Profiling spans.
+
+  With --profile FILE, the stages of event handling and rendering are
+  written to FILE as begin and end events in the Chrome trace event
+  format, to be opened in chrome://tracing or ui.perfetto.dev. End events
+  carry the device and the number of points handled as arguments. The
+  file is a JSON array that is closed on a clean shutdown. Both viewers
+  accept it unclosed as well, so it is still usable after a crash.
+*/
+
+#include "main.h"
+
+#define GROMIT_PROFILE_BEGIN(data, name)				\
+  do {									\
+    if ((data)->profile)						\
+      profile_begin (data, name);					\
+  } while (0)
+
+/* device may be NULL and points -1 if they do not apply */
+#define GROMIT_PROFILE_END(data, name, device, points)			\
+  do {									\
+    if ((data)->profile)						\
+      profile_end (data, name, device, points);				\
+  } while (0)
+
+gboolean profile_start (GromitData *data, const gchar *filename);
+void profile_stop (GromitData *data);
+
+void profile_begin (GromitData *data, const gchar *name);
+void profile_end (GromitData *data, const gchar *name, GdkDevice *device, gint points);
+
+#endif
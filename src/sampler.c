@@ -0,0 +1,488 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <gdk/gdk.h>
+#ifdef GDK_WINDOWING_X11
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/XInput2.h>
+#include <gdk/gdkx.h>
+#endif
+
+#include "sampler.h"
+
+#ifdef GDK_WINDOWING_X11
+
+/* pointer buttons that draw, as opposed to scroll wheel buttons */
+#define GROMIT_SAMPLER_MAX_BUTTON 3
+
+struct _GromitSampler
+{
+  GThread  *thread;
+  Display  *display;
+  Window    root;
+  gint      xi_opcode;
+  gint      wakeup[2];
+  guint8    log_level;  /* of the input category, see log.h */
+
+  /* master pointers to read, set by the main loop, see sampler_select() */
+  GMutex    lock;
+  GArray   *wanted;
+  /* thread only: those whose raw events are selected now */
+  GArray   *selected;
+
+  /* thread only: held buttons per master, axes per slave, root size */
+  GHashTable *buttons;
+  GHashTable *slaves;
+  Atom        pressure_label;
+  gint        width;
+  gint        height;
+
+  /* head is only written by the thread, tail only by the main loop */
+  GromitSample ring[GROMIT_SAMPLE_RING_SIZE];
+  gint         head;
+  gint         tail;
+  gint         dropped;
+};
+
+typedef struct
+{
+  gint    number;
+  gdouble min;
+  gdouble max;
+} GromitAxis;
+
+typedef struct
+{
+  GromitAxis x;
+  GromitAxis y;
+  GromitAxis pressure;  /* number is -1 if there is none */
+  gboolean   moved;     /* whether last_x and last_y are set */
+  gdouble    last_x;
+  gdouble    last_y;
+} GromitSlave;
+
+
+static void push (GromitSampler *sampler, const GromitSample *sample)
+{
+  guint head = g_atomic_int_get (&sampler->head);
+
+  /* unsigned, so the indices may wrap around */
+  if (head - (guint) g_atomic_int_get (&sampler->tail) >= GROMIT_SAMPLE_RING_SIZE)
+    {
+      g_atomic_int_inc (&sampler->dropped);
+      return;
+    }
+
+  sampler->ring[head & (GROMIT_SAMPLE_RING_SIZE - 1)] = *sample;
+  g_atomic_int_set (&sampler->head, (gint) (head + 1));
+}
+
+
+/*
+  Axes of a slave device, NULL for devices that do not report absolute
+  positions, like mice, whose raw events only carry unaccelerated deltas.
+*/
+static GromitSlave *get_slave (GromitSampler *sampler, gint sourceid)
+{
+  GromitSlave *slave;
+  XIDeviceInfo *info;
+  gboolean x = FALSE, y = FALSE;
+  gint n, i;
+
+  if (g_hash_table_lookup_extended (sampler->slaves, GINT_TO_POINTER (sourceid),
+				    NULL, (gpointer *) &slave))
+    return slave;
+
+  slave = g_malloc0 (sizeof (GromitSlave));
+  slave->pressure.number = -1;
+
+  info = XIQueryDevice (sampler->display, sourceid, &n);
+  if (info)
+    {
+      for (i = 0; i < info->num_classes; i++)
+	{
+	  XIValuatorClassInfo *v = (XIValuatorClassInfo *) info->classes[i];
+	  GromitAxis *axis;
+
+	  if (v->type != XIValuatorClass || v->max <= v->min)
+	    continue;
+
+	  /* the first two valuators are the position */
+	  if (v->number == 0 && v->mode == XIModeAbsolute)
+	    {
+	      axis = &slave->x;
+	      x = TRUE;
+	    }
+	  else if (v->number == 1 && v->mode == XIModeAbsolute)
+	    {
+	      axis = &slave->y;
+	      y = TRUE;
+	    }
+	  else if (v->label == sampler->pressure_label)
+	    axis = &slave->pressure;
+	  else
+	    continue;
+
+	  axis->number = v->number;
+	  axis->min = v->min;
+	  axis->max = v->max;
+	}
+      XIFreeDeviceInfo (info);
+    }
+
+  if (!x || !y)
+    {
+      g_free (slave);
+      slave = NULL;
+    }
+
+  /* devices without absolute axes are remembered as NULL */
+  g_hash_table_insert (sampler->slaves, GINT_TO_POINTER (sourceid), slave);
+  return slave;
+}
+
+
+/* The value of axis scaled to 0..1, or -1 if the event does not carry it. */
+static gdouble get_axis (XIRawEvent *raw, const GromitAxis *axis)
+{
+  gdouble *value = raw->valuators.values;
+  gint i;
+
+  if (axis->number < 0 || axis->number >= raw->valuators.mask_len * 8
+      || !XIMaskIsSet (raw->valuators.mask, axis->number))
+    return -1;
+
+  /* values only holds the valuators set in the mask */
+  for (i = 0; i < axis->number; i++)
+    if (XIMaskIsSet (raw->valuators.mask, i))
+      value++;
+
+  return CLAMP ((*value - axis->min) / (axis->max - axis->min), 0, 1);
+}
+
+
+static void handle_raw_event (GromitSampler *sampler, XIRawEvent *raw)
+{
+  gint held = GPOINTER_TO_INT (g_hash_table_lookup (sampler->buttons, GINT_TO_POINTER (raw->deviceid)));
+  GromitSample sample;
+  GromitSlave *slave;
+  gdouble x, y;
+
+  switch (raw->evtype)
+    {
+    case XI_RawButtonPress:
+    case XI_RawButtonRelease:
+      if (raw->detail < 1 || raw->detail > GROMIT_SAMPLER_MAX_BUTTON)
+	return;
+      held += raw->evtype == XI_RawButtonPress ? 1 : -1;
+      g_hash_table_insert (sampler->buttons, GINT_TO_POINTER (raw->deviceid),
+			   GINT_TO_POINTER (MAX (held, 0)));
+      return;
+
+    case XI_RawMotion:
+      if (held <= 0)
+	return;
+
+      /*
+	 Absolute devices are mapped onto the whole root window. The values
+	 are reported after the server applied the device's transformation
+	 matrix, so scaling them is all that is left to do. The position then
+	 belongs to exactly the time the event carries. An axis that did not
+	 change is left out of the event, so take the position from the last
+	 sample of this device then.
+      */
+      slave = get_slave (sampler, raw->sourceid);
+      if (!slave)
+	return;
+
+      x = get_axis (raw, &slave->x);
+      y = get_axis (raw, &slave->y);
+      if ((x < 0 || y < 0) && !slave->moved)
+	return;
+
+      sample.deviceid = raw->deviceid;
+      sample.time = raw->time;
+      sample.x = x < 0 ? slave->last_x : x * sampler->width;
+      sample.y = y < 0 ? slave->last_y : y * sampler->height;
+      sample.pressure = get_axis (raw, &slave->pressure);
+      slave->moved = TRUE;
+      slave->last_x = sample.x;
+      slave->last_y = sample.y;
+      push (sampler, &sample);
+      return;
+
+    case XI_HierarchyChanged:
+      g_hash_table_remove_all (sampler->slaves);
+      return;
+    }
+}
+
+
+static gboolean has_device (GArray *devices, gint deviceid)
+{
+  guint i;
+
+  for (i = 0; i < devices->len; i++)
+    if (g_array_index (devices, gint, i) == deviceid)
+      return TRUE;
+
+  return FALSE;
+}
+
+
+/*
+  Select raw events of the wanted master pointers only, so that the
+  thread sleeps while nothing is grabbed. Devices no longer wanted get
+  an empty mask, and their held buttons are forgotten, as their release
+  will not be seen any more.
+*/
+static void select_devices (GromitSampler *sampler)
+{
+  unsigned char bits[XIMaskLen (XI_LASTEVENT)] = { 0 };
+  unsigned char none[XIMaskLen (XI_LASTEVENT)] = { 0 };
+  GArray *masks = g_array_new (FALSE, FALSE, sizeof (XIEventMask));
+  XIEventMask mask;
+  guint i;
+
+  XISetMask (bits, XI_RawMotion);
+  XISetMask (bits, XI_RawButtonPress);
+  XISetMask (bits, XI_RawButtonRelease);
+
+  g_mutex_lock (&sampler->lock);
+
+  for (i = 0; i < sampler->selected->len; i++)
+    {
+      gint deviceid = g_array_index (sampler->selected, gint, i);
+      if (has_device (sampler->wanted, deviceid))
+	continue;
+      mask.deviceid = deviceid;
+      mask.mask_len = sizeof (none);
+      mask.mask = none;
+      g_array_append_val (masks, mask);
+      g_hash_table_remove (sampler->buttons, GINT_TO_POINTER (deviceid));
+    }
+
+  for (i = 0; i < sampler->wanted->len; i++)
+    {
+      mask.deviceid = g_array_index (sampler->wanted, gint, i);
+      mask.mask_len = sizeof (bits);
+      mask.mask = bits;
+      g_array_append_val (masks, mask);
+    }
+
+  g_array_set_size (sampler->selected, 0);
+  g_array_append_vals (sampler->selected, sampler->wanted->data, sampler->wanted->len);
+
+  g_mutex_unlock (&sampler->lock);
+
+  if (masks->len > 0)
+    {
+      XISelectEvents (sampler->display, sampler->root, (XIEventMask *) masks->data, masks->len);
+      XFlush (sampler->display);
+    }
+  g_array_free (masks, TRUE);
+}
+
+
+static gpointer sampler_thread (gpointer user_data)
+{
+  GromitSampler *sampler = user_data;
+  GPollFD fds[2];
+  XEvent ev;
+
+  fds[0].fd = ConnectionNumber (sampler->display);
+  fds[0].events = G_IO_IN;
+  fds[1].fd = sampler->wakeup[0];
+  fds[1].events = G_IO_IN;
+
+  for (;;)
+    {
+      while (XPending (sampler->display))
+	{
+	  XNextEvent (sampler->display, &ev);
+	  if (ev.type == ConfigureNotify && ev.xconfigure.window == sampler->root)
+	    {
+	      /* the root window grows and shrinks with monitor changes */
+	      sampler->width = ev.xconfigure.width;
+	      sampler->height = ev.xconfigure.height;
+	    }
+	  else if (ev.xcookie.type == GenericEvent && ev.xcookie.extension == sampler->xi_opcode
+	      && XGetEventData (sampler->display, &ev.xcookie))
+	    {
+	      handle_raw_event (sampler, ev.xcookie.data);
+	      XFreeEventData (sampler->display, &ev.xcookie);
+	    }
+	}
+
+      fds[0].revents = fds[1].revents = 0;
+      g_poll (fds, 2, -1);
+      if (fds[1].revents)
+	{
+	  gchar command;
+
+	  if (read (sampler->wakeup[0], &command, 1) != 1 || command == 'q')
+	    break;
+	  select_devices (sampler);
+	}
+    }
+
+  return NULL;
+}
+
+
+GromitSampler *sampler_new (GromitData *data)
+{
+  GromitSampler *sampler;
+  XIEventMask mask;
+  unsigned char bits[XIMaskLen (XI_LASTEVENT)] = { 0 };
+  gint event, error, major = 2, minor = 2;
+  Display *display;
+
+  if (!GDK_IS_X11_DISPLAY (data->display))
+    return NULL;
+
+  /* a connection of our own, so the thread never touches GDK's */
+  display = XOpenDisplay (DisplayString (GDK_DISPLAY_XDISPLAY (data->display)));
+  if (!display)
+    return NULL;
+
+  sampler = g_malloc0 (sizeof (GromitSampler));
+  sampler->display = display;
+  sampler->log_level = data->log_levels[GROMIT_LOG_INPUT];
+
+  if (!XQueryExtension (display, "XInputExtension", &sampler->xi_opcode, &event, &error)
+      || XIQueryVersion (display, &major, &minor) != Success
+      || pipe (sampler->wakeup) != 0)
+    {
+      g_printerr ("WARNING: Could not start the input thread, using GDK's motion history.\n");
+      XCloseDisplay (display);
+      g_free (sampler);
+      return NULL;
+    }
+
+  sampler->root = DefaultRootWindow (display);
+  sampler->width = DisplayWidth (display, DefaultScreen (display));
+  sampler->height = DisplayHeight (display, DefaultScreen (display));
+  sampler->pressure_label = XInternAtom (display, "Abs Pressure", False);
+  sampler->buttons = g_hash_table_new (NULL, NULL);
+  sampler->slaves = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  g_mutex_init (&sampler->lock);
+  sampler->wanted = g_array_new (FALSE, FALSE, sizeof (gint));
+  sampler->selected = g_array_new (FALSE, FALSE, sizeof (gint));
+
+  /* raw pointer events are selected once devices get grabbed */
+  mask.deviceid = XIAllDevices;
+  mask.mask_len = sizeof (bits);
+  mask.mask = bits;
+  XISetMask (bits, XI_HierarchyChanged);
+  XISelectEvents (display, sampler->root, &mask, 1);
+  XSelectInput (display, sampler->root, StructureNotifyMask);
+  XFlush (display);
+
+  sampler->thread = g_thread_new ("gromit-input", sampler_thread, sampler);
+
+  GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "Input thread started.");
+
+  return sampler;
+}
+
+
+void sampler_free (GromitSampler *sampler)
+{
+  if (!sampler)
+    return;
+
+  if (write (sampler->wakeup[1], "q", 1) == 1)
+    g_thread_join (sampler->thread);
+
+  if (sampler->log_level >= GROMIT_LOG_DEBUG)
+    log_write (GROMIT_LOG_INPUT, GROMIT_LOG_DEBUG, "Input thread stopped, %d samples dropped.",
+	       g_atomic_int_get (&sampler->dropped));
+
+  close (sampler->wakeup[0]);
+  close (sampler->wakeup[1]);
+  g_hash_table_destroy (sampler->buttons);
+  g_hash_table_destroy (sampler->slaves);
+  g_array_free (sampler->wanted, TRUE);
+  g_array_free (sampler->selected, TRUE);
+  g_mutex_clear (&sampler->lock);
+  XCloseDisplay (sampler->display);
+  g_free (sampler);
+}
+
+
+void sampler_select (GromitSampler *sampler, const gint *deviceids, guint n)
+{
+  g_mutex_lock (&sampler->lock);
+  g_array_set_size (sampler->wanted, 0);
+  g_array_append_vals (sampler->wanted, deviceids, n);
+  g_mutex_unlock (&sampler->lock);
+
+  /* the thread owns the connection, so it does the selecting */
+  if (write (sampler->wakeup[1], "s", 1) != 1)
+    g_printerr ("WARNING: Could not reach the input thread.\n");
+}
+
+
+guint sampler_drain (GromitSampler *sampler,
+		     void (*func) (const GromitSample *sample, gpointer user_data),
+		     gpointer user_data)
+{
+  guint head = g_atomic_int_get (&sampler->head);
+  guint tail = g_atomic_int_get (&sampler->tail);
+  guint n = head - tail;
+
+  for (; tail != head; tail++)
+    func (&sampler->ring[tail & (GROMIT_SAMPLE_RING_SIZE - 1)], user_data);
+
+  g_atomic_int_set (&sampler->tail, (gint) tail);
+
+  return n;
+}
+
+#else
+
+GromitSampler *sampler_new (GromitData *data)
+{
+  return NULL;
+}
+
+void sampler_free (GromitSampler *sampler)
+{
+}
+
+void sampler_select (GromitSampler *sampler, const gint *deviceids, guint n)
+{
+}
+
+guint sampler_drain (GromitSampler *sampler,
+		     void (*func) (const GromitSample *sample, gpointer user_data),
+		     gpointer user_data)
+{
+  return 0;
+}
+
+#endif
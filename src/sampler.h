@@ -0,0 +1,64 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+/*
+  Pen sample reader thread.
+
+  On X11, a thread with its own connection to the X server reads raw
+  XInput2 events of the grabbed pointers, so that samples are captured even
+  while the main loop is busy. While a button is held, every motion of a
+  device with absolute axes, like a pen or touchscreen, is turned into a
+  timestamped sample in screen coordinates taken from the event itself,
+  and pushed into a single-producer single-consumer ring. The main loop
+  drains the ring and uses the samples in place of GDK's motion history.
+  Raw events of mice only carry relative motion, so for them GDK's motion
+  history is used as before.
+*/
+
+#include "main.h"
+
+#define GROMIT_SAMPLE_RING_SIZE 4096 /* must be a power of two */
+
+typedef struct
+{
+  gint    deviceid;  /* XInput2 id of the master pointer */
+  guint32 time;
+  gdouble x;
+  gdouble y;
+  gdouble pressure;  /* 0..1, or -1 if the device has none */
+} GromitSample;
+
+/* Returns NULL if there is no X11 display or XInput 2.2 to read from. */
+GromitSampler *sampler_new (GromitData *data);
+void sampler_free (GromitSampler *sampler);
+
+/* Read the given master pointers only, as they get grabbed and released. */
+void sampler_select (GromitSampler *sampler, const gint *deviceids, guint n);
+
+/* Move all samples out of the ring. To be called from the main thread only. */
+guint sampler_drain (GromitSampler *sampler, void (*func) (const GromitSample *sample, gpointer user_data), gpointer user_data);
+
+#endif
@@ -0,0 +1,296 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+#include "scan.h"
+
+/* pixels per word of a row's bitmask */
+#define MASK_BITS 64
+
+typedef void (*RowMaskFunc) (const guint32 *row, gint width, guint64 *mask);
+
+
+/*
+  ARGB32 is premultiplied with alpha in the top byte, so a pixel is at
+  least half opaque exactly if its top bit is set. That is the threshold
+  the conversion to a bitmap in gdk_cairo_region_create_from_surface()
+  applies, too.
+*/
+static void row_mask_scalar (const guint32 *row, gint width, guint64 *mask)
+{
+  gint x = 0, w, i;
+
+  for (w = 0; x < width; w++)
+    {
+      gint end = MIN (x + MASK_BITS, width);
+      guint64 m = 0;
+
+      for (i = 0; x < end; i++, x++)
+	m |= (guint64) (row[x] >> 31) << i;
+      mask[w] = m;
+    }
+}
+
+
+#ifdef SCAN_X86
+/* movemask collects exactly the top bits of the pixels */
+__attribute__ ((target ("sse2")))
+static void row_mask_sse2 (const guint32 *row, gint width, guint64 *mask)
+{
+  gint x = 0, w, i;
+
+  for (w = 0; x + MASK_BITS <= width; w++)
+    {
+      guint64 m = 0;
+
+      for (i = 0; i < MASK_BITS; i += 4, x += 4)
+	m |= (guint64) _mm_movemask_ps (_mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *) (row + x)))) << i;
+      mask[w] = m;
+    }
+
+  if (x < width)
+    row_mask_scalar (row + x, width - x, mask + w);
+}
+
+
+__attribute__ ((target ("avx")))
+static void row_mask_avx (const guint32 *row, gint width, guint64 *mask)
+{
+  gint x = 0, w, i;
+
+  for (w = 0; x + MASK_BITS <= width; w++)
+    {
+      guint64 m = 0;
+
+      for (i = 0; i < MASK_BITS; i += 8, x += 8)
+	m |= (guint64) _mm256_movemask_ps (_mm256_castsi256_ps (_mm256_loadu_si256 ((const __m256i *) (row + x)))) << i;
+      mask[w] = m;
+    }
+
+  if (x < width)
+    row_mask_scalar (row + x, width - x, mask + w);
+}
+#endif
+
+
+static RowMaskFunc row_mask_func (GromitScanImpl impl)
+{
+  switch (impl)
+    {
+#ifdef SCAN_X86
+    case GROMIT_SCAN_AVX:
+      return row_mask_avx;
+    case GROMIT_SCAN_SSE2:
+      return row_mask_sse2;
+#endif
+    default:
+      return row_mask_scalar;
+    }
+}
+
+
+GromitScanImpl scan_get_impl (void)
+{
+#ifdef SCAN_X86
+  static gint impl = -1;
+
+  if (impl < 0)
+    {
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx"))
+	impl = GROMIT_SCAN_AVX;
+      else if (__builtin_cpu_supports ("sse2"))
+	impl = GROMIT_SCAN_SSE2;
+      else
+	impl = GROMIT_SCAN_SCALAR;
+    }
+  return impl;
+#else
+  return GROMIT_SCAN_SCALAR;
+#endif
+}
+
+
+const gchar *scan_impl_name (GromitScanImpl impl)
+{
+  switch (impl)
+    {
+    case GROMIT_SCAN_AVX:
+      return "avx";
+    case GROMIT_SCAN_SSE2:
+      return "sse2";
+    default:
+      return "scalar";
+    }
+}
+
+
+static inline gint lowest_bit (guint64 m)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll (m);
+#else
+  gint n = 0;
+  for (; !(m & 1); m >>= 1)
+    n++;
+  return n;
+#endif
+}
+
+
+/*
+  Add a rectangle for every run of set bits in mask, which describes the
+  rows y to y + height - 1 of a width pixels wide area starting at x.
+*/
+static void add_band (GArray *rects,
+		      const guint64 *mask,
+		      gint x, gint width,
+		      gint y, gint height)
+{
+  cairo_rectangle_int_t rect = {0, y, 0, height};
+  gint words = (width + MASK_BITS - 1) / MASK_BITS;
+  gint w, start = -1;
+
+  for (w = 0; w < words; w++)
+    {
+      guint64 m = mask[w];
+      gint bit = 0;
+
+      /* skip words that neither start nor end a run */
+      if (m == (start < 0 ? 0 : G_MAXUINT64))
+	continue;
+
+      while (bit < MASK_BITS)
+	{
+	  guint64 rest = (start < 0 ? m : ~m) >> bit;
+
+	  if (rest == 0)
+	    break;
+	  bit += lowest_bit (rest);
+
+	  if (start < 0)
+	    start = w * MASK_BITS + bit;
+	  else
+	    {
+	      rect.x = x + start;
+	      rect.width = w * MASK_BITS + bit - start;
+	      g_array_append_val (rects, rect);
+	      start = -1;
+	    }
+	}
+    }
+
+  /* bits past width are clear, so only a run reaching the edge is left */
+  if (start >= 0)
+    {
+      rect.x = x + start;
+      rect.width = width - start;
+      g_array_append_val (rects, rect);
+    }
+}
+
+
+/* What the shape was scanned with before, for surfaces of other formats. */
+static cairo_region_t *scan_gdk (cairo_surface_t *surface, const cairo_rectangle_int_t *rect)
+{
+  cairo_surface_t *sub = cairo_surface_create_for_rectangle (surface,
+							     rect->x, rect->y,
+							     rect->width, rect->height);
+  cairo_region_t *r = gdk_cairo_region_create_from_surface (sub);
+  cairo_surface_destroy (sub);
+  cairo_region_translate (r, rect->x, rect->y);
+  return r;
+}
+
+
+cairo_region_t *scan_alpha_region_with (GromitScanImpl impl,
+					cairo_surface_t *surface,
+					const cairo_rectangle_int_t *rect)
+{
+  RowMaskFunc row_mask = row_mask_func (impl);
+  cairo_rectangle_int_t bounds, area;
+  cairo_region_t *region;
+  const guint8 *pixels;
+  guint64 *masks, *cur, *prev, *tmp;
+  GArray *rects;
+  gint stride, words, y, band;
+
+  if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE
+      || cairo_image_surface_get_format (surface) != CAIRO_FORMAT_ARGB32)
+    return scan_gdk (surface, rect);
+
+  bounds.x = bounds.y = 0;
+  bounds.width = cairo_image_surface_get_width (surface);
+  bounds.height = cairo_image_surface_get_height (surface);
+  if (!gdk_rectangle_intersect (rect, &bounds, &area))
+    return cairo_region_create ();
+
+  cairo_surface_flush (surface);
+  pixels = cairo_image_surface_get_data (surface);
+  stride = cairo_image_surface_get_stride (surface);
+
+  words = (area.width + MASK_BITS - 1) / MASK_BITS;
+  masks = g_new (guint64, 2 * words);
+  cur = masks;
+  prev = masks + words;
+  rects = g_array_new (FALSE, FALSE, sizeof (cairo_rectangle_int_t));
+
+  /* rows with the same mask as the one before extend its band */
+  band = area.y;
+  for (y = area.y; y < area.y + area.height; y++)
+    {
+      row_mask ((const guint32 *) (pixels + (gsize) y * stride) + area.x, area.width, cur);
+
+      if (y > band)
+	{
+	  if (memcmp (cur, prev, words * sizeof (guint64)) == 0)
+	    continue;
+	  add_band (rects, prev, area.x, area.width, band, y - band);
+	}
+
+      tmp = prev;
+      prev = cur;
+      cur = tmp;
+      band = y;
+    }
+  add_band (rects, prev, area.x, area.width, band, area.y + area.height - band);
+
+  region = cairo_region_create_rectangles ((cairo_rectangle_int_t *) rects->data, rects->len);
+
+  g_array_free (rects, TRUE);
+  g_free (masks);
+
+  return region;
+}
+
+
+cairo_region_t *scan_alpha_region (cairo_surface_t *surface, const cairo_rectangle_int_t *rect)
+{
+  return scan_alpha_region_with (scan_get_impl (), surface, rect);
+}
@@ -0,0 +1,63 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+/*
+  Alpha mask to region scanner.
+
+  Does what gdk_cairo_region_create_from_surface() does for the ARGB32
+  surfaces the shape is built from, giving the same region, but reads the
+  alpha channel directly instead of converting to a bitmap first. Each row
+  is turned into a bitmask of the pixels that are at least half opaque,
+  with SSE2 or AVX where the CPU has them, identical consecutive rows are
+  merged into one band, and the region is built from the bands' runs in
+  one go instead of one rectangle at a time.
+*/
+
+#include <gdk/gdk.h>
+
+typedef enum
+{
+  GROMIT_SCAN_SCALAR,
+  GROMIT_SCAN_SSE2,
+  GROMIT_SCAN_AVX
+} GromitScanImpl;
+
+/* The fastest implementation this CPU supports. */
+GromitScanImpl scan_get_impl (void);
+const gchar *scan_impl_name (GromitScanImpl impl);
+
+/*
+  Return the region of the pixels of surface within rect that are at
+  least half opaque, in surface coordinates.
+*/
+cairo_region_t *scan_alpha_region (cairo_surface_t *surface, const cairo_rectangle_int_t *rect);
+
+/* The same with the given implementation, which must not be better than scan_get_impl(). */
+cairo_region_t *scan_alpha_region_with (GromitScanImpl impl,
+					cairo_surface_t *surface,
+					const cairo_rectangle_int_t *rect);
+
+#endif
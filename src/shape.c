@@ -0,0 +1,143 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "shape.h"
+#include "drawing.h"
+#include "tiles.h"
+#include "scan.h"
+
+
+static void shape_apply (GromitData *data)
+{
+  data->drawing_ops->shape(data, data->shape_region);
+}
+
+
+typedef struct
+{
+  cairo_surface_t *surface;
+  cairo_region_t *region;
+} ShapeScan;
+
+
+/* Add the non-transparent part of one tile to the scan's region. */
+static void scan_tile (const GdkRectangle *tile, gpointer user_data)
+{
+  ShapeScan *scan = user_data;
+  cairo_region_t *r = scan_alpha_region(scan->surface, tile);
+  cairo_region_union(scan->region, r);
+  cairo_region_destroy(r);
+}
+
+
+/*
+  Scan the populated tiles of the backbuffer and the preview layer within
+  clip (or all of them) into region. Empty tiles are known to be transparent.
+*/
+static void scan_tiles (GromitData *data, const GdkRectangle *clip, cairo_region_t *region)
+{
+  ShapeScan scan = {data->backbuffer, region};
+  tiled_surface_foreach(data->backbuffer, clip, scan_tile, &scan);
+
+  scan.surface = data->preview;
+  tiled_surface_foreach(data->preview, clip, scan_tile, &scan);
+}
+
+
+void shape_rebuild (GromitData *data)
+{
+  if (data->shape_region)
+    cairo_region_destroy(data->shape_region);
+  data->shape_region = cairo_region_create();
+  scan_tiles(data, NULL, data->shape_region);
+
+  if (data->shape_damage)
+    cairo_region_destroy(data->shape_damage);
+  data->shape_damage = cairo_region_create();
+
+  shape_apply(data);
+
+  GROMIT_DEBUG (data, GROMIT_LOG_DRAW, "Rebuilt shape from whole backbuffer, %d rectangles.",
+		cairo_region_num_rectangles(data->shape_region));
+}
+
+
+void shape_clear (GromitData *data)
+{
+  if (data->shape_region)
+    cairo_region_destroy(data->shape_region);
+  data->shape_region = cairo_region_create();
+
+  if (data->shape_damage)
+    cairo_region_destroy(data->shape_damage);
+  data->shape_damage = cairo_region_create();
+
+  shape_apply(data);
+}
+
+
+void shape_damage (GromitData *data, const GdkRectangle *rect)
+{
+  GdkRectangle bounds = {0, 0,
+			 cairo_image_surface_get_width(data->backbuffer),
+			 cairo_image_surface_get_height(data->backbuffer)};
+  GdkRectangle clipped;
+
+  /* the shape is only used without a compositor */
+  if (data->composited || !data->shape_damage)
+    return;
+
+  if (gdk_rectangle_intersect(rect, &bounds, &clipped))
+    cairo_region_union_rectangle(data->shape_damage, &clipped);
+}
+
+
+void shape_update (GromitData *data)
+{
+  gint i, n;
+
+  if (!data->shape_region)
+    {
+      shape_rebuild(data);
+      return;
+    }
+
+  n = cairo_region_num_rectangles(data->shape_damage);
+  for (i = 0; i < n; i++)
+    {
+      cairo_rectangle_int_t rect;
+      cairo_region_get_rectangle(data->shape_damage, i, &rect);
+
+      cairo_region_subtract_rectangle(data->shape_region, &rect);
+      scan_tiles(data, &rect, data->shape_region);
+    }
+
+  GROMIT_TRACE (data, GROMIT_LOG_DRAW, "Rescanned %d damaged rectangles, shape now has %d rectangles.",
+		n, cairo_region_num_rectangles(data->shape_region));
+
+  cairo_region_destroy(data->shape_damage);
+  data->shape_damage = cairo_region_create();
+
+  shape_apply(data);
+}
+
@@ -0,0 +1,47 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef SHAPE_H
+#define SHAPE_H
+
+/*
+  Window shape handling for the non-composited case.
+  The shape region is kept in step with the backbuffer: drawing functions
+  report the rectangles they touched and only those get rescanned.
+*/
+
+#include "main.h"
+
+/* Throw away the current shape and rescan the whole backbuffer. */
+void shape_rebuild (GromitData *data);
+
+/* Set the shape to the empty region, for a freshly cleared backbuffer. */
+void shape_clear (GromitData *data);
+
+/* Mark a rectangle of the backbuffer as in need of rescanning. */
+void shape_damage (GromitData *data, const GdkRectangle *rect);
+
+/* Rescan all damaged rectangles and apply the result to the window. */
+void shape_update (GromitData *data);
+
+#endif
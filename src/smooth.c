@@ -0,0 +1,150 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "smooth.h"
+#include "drawing.h"
+
+typedef struct
+{
+  gint  x;
+  gint  y;
+  guint width;
+} GromitSmoothPoint;
+
+struct _GromitSmoother
+{
+  /* the last four points, p[3] being the newest */
+  GromitSmoothPoint p[4];
+  guint             n;
+  guint             step;
+  gboolean          active;
+};
+
+
+GromitSmoother *smoother_new (void)
+{
+  return g_malloc0 (sizeof (GromitSmoother));
+}
+
+
+void smoother_free (GromitSmoother *smoother)
+{
+  g_free (smoother);
+}
+
+
+void smoother_begin (GromitSmoother *smoother, gint x, gint y, guint width, guint step)
+{
+  GromitSmoothPoint point = {x, y, width};
+
+  /* the first point stands in for the one before it */
+  smoother->p[2] = smoother->p[3] = point;
+  smoother->n = 1;
+  smoother->step = MAX (step, 1);
+  smoother->active = TRUE;
+}
+
+
+gboolean smoother_is_active (GromitSmoother *smoother)
+{
+  return smoother->active;
+}
+
+
+/* Emit the curve from p[1] to p[2], with p[0] and p[3] as control points. */
+static void emit_curve (GromitSmoother *smoother, GArray *segments)
+{
+  const GromitSmoothPoint *p = smoother->p;
+  gdouble chord = hypot (p[2].x - p[1].x, p[2].y - p[1].y);
+  /* points are on screen, so even a jump across it stays a few thousand steps */
+  guint steps = MAX ((guint) ceil (chord / smoother->step), 1);
+  gint lastx = p[1].x, lasty = p[1].y;
+  guint i;
+
+  for (i = 1; i <= steps; i++)
+    {
+      gdouble t = (gdouble) i / steps, t2 = t * t, t3 = t2 * t;
+      GromitSegment segment;
+
+      segment.x1 = lastx;
+      segment.y1 = lasty;
+      segment.x2 = lround (0.5 * (2 * p[1].x + (p[2].x - p[0].x) * t
+				  + (2 * p[0].x - 5 * p[1].x + 4 * p[2].x - p[3].x) * t2
+				  + (3 * p[1].x - p[0].x - 3 * p[2].x + p[3].x) * t3));
+      segment.y2 = lround (0.5 * (2 * p[1].y + (p[2].y - p[0].y) * t
+				  + (2 * p[0].y - 5 * p[1].y + 4 * p[2].y - p[3].y) * t2
+				  + (3 * p[1].y - p[0].y - 3 * p[2].y + p[3].y) * t3));
+      /* the width changes at input points only, so runs stay long */
+      segment.width = p[2].width;
+
+      if (segment.x2 == lastx && segment.y2 == lasty && i < steps)
+	continue;
+
+      g_array_append_val (segments, segment);
+      lastx = segment.x2;
+      lasty = segment.y2;
+    }
+}
+
+
+void smoother_add (GromitSmoother *smoother, gint x, gint y, guint width, GArray *segments)
+{
+  GromitSmoothPoint point = {x, y, width};
+
+  if (!smoother->active)
+    return;
+
+  if (x == smoother->p[3].x && y == smoother->p[3].y)
+    {
+      smoother->p[3].width = width;
+      return;
+    }
+
+  memmove (smoother->p, smoother->p + 1, 3 * sizeof (GromitSmoothPoint));
+  smoother->p[3] = point;
+  smoother->n++;
+
+  /* p[1] and p[2] are now both real points */
+  if (smoother->n >= 3)
+    emit_curve (smoother, segments);
+}
+
+
+void smoother_end (GromitSmoother *smoother, GArray *segments)
+{
+  if (!smoother->active)
+    return;
+
+  /* the last point stands in for the one after it */
+  if (smoother->n >= 2)
+    {
+      memmove (smoother->p, smoother->p + 1, 3 * sizeof (GromitSmoothPoint));
+      emit_curve (smoother, segments);
+    }
+
+  smoother->n = 0;
+  smoother->active = FALSE;
+}
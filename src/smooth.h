@@ -0,0 +1,50 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef SMOOTH_H
+#define SMOOTH_H
+
+/*
+  Streaming stroke smoother.
+
+  Input points are joined by Catmull-Rom splines instead of straight
+  lines. The curve between two points depends on their neighbours, so
+  each curve is emitted once the point after it arrives, and the last one
+  when the stroke ends. Curves are flattened into segments of at most
+  the tool's smooth length in pixels.
+*/
+
+#include "main.h"
+
+GromitSmoother *smoother_new (void);
+void smoother_free (GromitSmoother *smoother);
+
+/* Start a stroke at x,y, flattening curves into segments of at most step pixels. */
+void smoother_begin (GromitSmoother *smoother, gint x, gint y, guint width, guint step);
+gboolean smoother_is_active (GromitSmoother *smoother);
+/* Feed a point, appending the GromitSegments it completes to segments. */
+void smoother_add (GromitSmoother *smoother, gint x, gint y, guint width, GArray *segments);
+/* End the stroke, appending the segments of the last curve. */
+void smoother_end (GromitSmoother *smoother, GArray *segments);
+
+#endif
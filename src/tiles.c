@@ -0,0 +1,496 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* for mremap() */
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "tiles.h"
+
+#define TILE_ROW_BYTES (GROMIT_TILE_WIDTH * 4)
+
+/*
+  Mapped rows leave room for screens up to this many tiles wide, so that
+  tiled_surface_resize() can keep the pixels where they are. It is only
+  address space, pages are committed as tiles get drawn into.
+*/
+#define TILE_RESERVE_COLS 8
+
+typedef struct
+{
+  guchar   *pixels;
+  gsize     size;
+  gint      stride;
+  gint      width;
+  gint      height;
+  guint     cols;
+  guint     rows;
+  guint8   *populated;
+  guint     n_populated;
+  gboolean  mapped;
+} GromitTiles;
+
+static const cairo_user_data_key_t tiles_key;
+
+
+static GromitTiles *get_tiles (cairo_surface_t *surface)
+{
+  return cairo_surface_get_user_data (surface, &tiles_key);
+}
+
+
+static void tiles_free (void *ptr)
+{
+  GromitTiles *tiles = ptr;
+
+  if (tiles->mapped)
+    munmap (tiles->pixels, tiles->size);
+  else
+    g_free (tiles->pixels);
+  g_free (tiles->populated);
+  g_free (tiles);
+}
+
+
+static void tile_rect (GromitTiles *tiles, guint col, guint row, GdkRectangle *rect)
+{
+  rect->x = col * GROMIT_TILE_WIDTH;
+  rect->y = row * GROMIT_TILE_HEIGHT;
+  rect->width = MIN (GROMIT_TILE_WIDTH, tiles->width - rect->x);
+  rect->height = MIN (GROMIT_TILE_HEIGHT, tiles->height - rect->y);
+}
+
+
+/*
+  Zero a tile. Whole pages are given back to the kernel, which will hand
+  out fresh zero pages should the tile get drawn into again.
+*/
+static void release_tile (GromitTiles *tiles, guint col, guint row)
+{
+  GdkRectangle r;
+  gint y;
+  uintptr_t page = sysconf (_SC_PAGESIZE);
+
+  tile_rect (tiles, col, row, &r);
+
+  for (y = r.y; y < r.y + r.height; y++)
+    {
+      /* rows are padded to whole tile columns, so the full segment is ours */
+      guchar *start = tiles->pixels + (gsize) y * tiles->stride + (gsize) r.x * 4;
+      guchar *end = start + TILE_ROW_BYTES;
+
+      if (tiles->mapped)
+	{
+	  guchar *page_start = (guchar *) (((uintptr_t) start + page - 1) & ~(page - 1));
+	  guchar *page_end = (guchar *) ((uintptr_t) end & ~(page - 1));
+
+	  if (page_start < page_end)
+	    {
+	      madvise (page_start, page_end - page_start, MADV_DONTNEED);
+	      memset (start, 0, page_start - start);
+	      memset (page_end, 0, end - page_end);
+	      continue;
+	    }
+	}
+
+      memset (start, 0, end - start);
+    }
+}
+
+
+static void copy_tile (GromitTiles *dst, GromitTiles *src, guint col, guint row)
+{
+  GdkRectangle d, s;
+  gint y;
+
+  tile_rect (dst, col, row, &d);
+  tile_rect (src, col, row, &s);
+
+  for (y = 0; y < MIN (d.height, s.height); y++)
+    memcpy (dst->pixels + (gsize) (d.y + y) * dst->stride + (gsize) d.x * 4,
+	    src->pixels + (gsize) (s.y + y) * src->stride + (gsize) s.x * 4,
+	    MIN (d.width, s.width) * 4);
+}
+
+
+static void set_populated (GromitTiles *tiles, guint i, gboolean populated)
+{
+  if (tiles->populated[i] == populated)
+    return;
+
+  tiles->populated[i] = populated;
+  if (populated)
+    tiles->n_populated++;
+  else
+    tiles->n_populated--;
+}
+
+
+cairo_surface_t *tiled_surface_create (gint width, gint height)
+{
+  GromitTiles *tiles = g_malloc0 (sizeof (GromitTiles));
+  cairo_surface_t *surface;
+
+  tiles->width = width;
+  tiles->height = height;
+  tiles->cols = (width + GROMIT_TILE_WIDTH - 1) / GROMIT_TILE_WIDTH;
+  tiles->rows = (height + GROMIT_TILE_HEIGHT - 1) / GROMIT_TILE_HEIGHT;
+  tiles->populated = g_malloc0 (MAX (tiles->cols * tiles->rows, 1));
+
+  /* spare address space is scarce on 32 bit */
+  tiles->stride = MAX (tiles->cols, sizeof (gpointer) >= 8 ? TILE_RESERVE_COLS : 1) * TILE_ROW_BYTES;
+  tiles->size = (gsize) tiles->stride * MAX (height, 1);
+  tiles->pixels = mmap (NULL, tiles->size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (tiles->pixels != MAP_FAILED)
+    tiles->mapped = TRUE;
+  else
+    {
+      tiles->stride = MAX (tiles->cols, 1) * TILE_ROW_BYTES;
+      tiles->size = (gsize) tiles->stride * MAX (height, 1);
+      tiles->pixels = g_malloc0 (tiles->size);
+    }
+
+  surface = cairo_image_surface_create_for_data (tiles->pixels, CAIRO_FORMAT_ARGB32,
+						 width, height, tiles->stride);
+  cairo_surface_set_user_data (surface, &tiles_key, tiles, tiles_free);
+
+  return surface;
+}
+
+
+void tiled_surface_mark (cairo_surface_t *surface, const GdkRectangle *rect)
+{
+  GromitTiles *tiles = get_tiles (surface);
+  GdkRectangle bounds, clipped;
+  guint col, row;
+
+  if (!tiles)
+    return;
+
+  bounds.x = bounds.y = 0;
+  bounds.width = tiles->width;
+  bounds.height = tiles->height;
+  if (!gdk_rectangle_intersect (rect, &bounds, &clipped))
+    return;
+
+  for (row = clipped.y / GROMIT_TILE_HEIGHT;
+       row <= (guint) (clipped.y + clipped.height - 1) / GROMIT_TILE_HEIGHT; row++)
+    for (col = clipped.x / GROMIT_TILE_WIDTH;
+	 col <= (guint) (clipped.x + clipped.width - 1) / GROMIT_TILE_WIDTH; col++)
+      set_populated (tiles, row * tiles->cols + col, TRUE);
+}
+
+
+void tiled_surface_foreach (cairo_surface_t *surface,
+			    const GdkRectangle *clip,
+			    GromitTileFunc func,
+			    gpointer user_data)
+{
+  GromitTiles *tiles = get_tiles (surface);
+  GdkRectangle r, clipped;
+  guint col, row;
+
+  if (!tiles)
+    {
+      r.x = r.y = 0;
+      r.width = cairo_image_surface_get_width (surface);
+      r.height = cairo_image_surface_get_height (surface);
+      if (!clip)
+	func (&r, user_data);
+      else if (gdk_rectangle_intersect (&r, clip, &clipped))
+	func (&clipped, user_data);
+      return;
+    }
+
+  for (row = 0; row < tiles->rows; row++)
+    for (col = 0; col < tiles->cols; col++)
+      {
+	if (!tiles->populated[row * tiles->cols + col])
+	  continue;
+
+	tile_rect (tiles, col, row, &r);
+	if (!clip)
+	  func (&r, user_data);
+	else if (gdk_rectangle_intersect (&r, clip, &clipped))
+	  func (&clipped, user_data);
+      }
+}
+
+
+void tiled_surface_copy (cairo_surface_t *dst, cairo_surface_t *src)
+{
+  GromitTiles *d = get_tiles (dst);
+  GromitTiles *s = get_tiles (src);
+  guint col, row;
+
+  if (!d || !s)
+    {
+      cairo_t *cr = cairo_create (dst);
+      cairo_set_source_surface (cr, src, 0, 0);
+      cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+      cairo_paint (cr);
+      cairo_destroy (cr);
+
+      if (d)
+	{
+	  GdkRectangle all = {0, 0, d->width, d->height};
+	  tiled_surface_mark (dst, &all);
+	}
+      return;
+    }
+
+  cairo_surface_flush (src);
+  cairo_surface_flush (dst);
+
+  for (row = 0; row < d->rows; row++)
+    for (col = 0; col < d->cols; col++)
+      {
+	guint i = row * d->cols + col;
+	gboolean in_src = row < s->rows && col < s->cols && s->populated[row * s->cols + col];
+
+	/* if the sizes differ the copy might not cover the whole tile */
+	if (d->populated[i] && (!in_src || d->width != s->width || d->height != s->height))
+	  release_tile (d, col, row);
+
+	if (in_src)
+	  copy_tile (d, s, col, row);
+
+	set_populated (d, i, in_src);
+      }
+
+  cairo_surface_mark_dirty (dst);
+}
+
+
+cairo_surface_t *tiled_surface_resize (cairo_surface_t *surface, gint width, gint height)
+{
+  GromitTiles *tiles = get_tiles (surface);
+  GromitTiles *resized;
+  cairo_surface_t *result;
+  guint col, row;
+  guchar *pixels = MAP_FAILED;
+
+  resized = g_malloc0 (sizeof (GromitTiles));
+  resized->width = width;
+  resized->height = height;
+  resized->cols = (width + GROMIT_TILE_WIDTH - 1) / GROMIT_TILE_WIDTH;
+  resized->rows = (height + GROMIT_TILE_HEIGHT - 1) / GROMIT_TILE_HEIGHT;
+  resized->populated = g_malloc0 (MAX (resized->cols * resized->rows, 1));
+
+  if (tiles && tiles->mapped && resized->cols * TILE_ROW_BYTES <= (guint) tiles->stride)
+    {
+      cairo_surface_flush (surface);
+
+      /* drop whatever ends up outside, tiles that stay keep their index */
+      for (row = 0; row < tiles->rows; row++)
+	for (col = 0; col < tiles->cols; col++)
+	  {
+	    GdkRectangle r;
+	    gint y;
+
+	    if (!tiles->populated[row * tiles->cols + col])
+	      continue;
+
+	    if (col >= resized->cols || row >= resized->rows)
+	      {
+		release_tile (tiles, col, row);
+		set_populated (tiles, row * tiles->cols + col, FALSE);
+		continue;
+	      }
+
+	    /* rows below the new height go with the mapping, columns to the right stay */
+	    tile_rect (tiles, col, row, &r);
+	    if (r.x + r.width > width)
+	      for (y = r.y; y < MIN (r.y + r.height, height); y++)
+		memset (tiles->pixels + (gsize) y * tiles->stride + (gsize) width * 4, 0,
+			(r.x + r.width - width) * 4);
+
+	    resized->populated[row * resized->cols + col] = TRUE;
+	    resized->n_populated++;
+	  }
+
+#ifdef MREMAP_MAYMOVE
+      pixels = mremap (tiles->pixels, tiles->size,
+		       (gsize) tiles->stride * MAX (height, 1), MREMAP_MAYMOVE);
+#endif
+    }
+
+  if (pixels == MAP_FAILED)
+    {
+      g_free (resized->populated);
+      g_free (resized);
+      result = tiled_surface_create (width, height);
+      tiled_surface_copy (result, surface);
+      cairo_surface_destroy (surface);
+      return result;
+    }
+
+  /* the pixels have moved over, the old surface must not touch them any more */
+  resized->pixels = pixels;
+  resized->stride = tiles->stride;
+  resized->size = (gsize) tiles->stride * MAX (height, 1);
+  resized->mapped = TRUE;
+  tiles->pixels = NULL;
+  tiles->mapped = FALSE;
+  cairo_surface_finish (surface);
+  cairo_surface_destroy (surface);
+
+  result = cairo_image_surface_create_for_data (resized->pixels, CAIRO_FORMAT_ARGB32,
+						width, height, resized->stride);
+  cairo_surface_set_user_data (result, &tiles_key, resized, tiles_free);
+
+  return result;
+}
+
+
+void tiled_surface_clip (cairo_surface_t *surface, const cairo_region_t *keep)
+{
+  GromitTiles *tiles = get_tiles (surface);
+  cairo_region_t *drop;
+  cairo_t *cr;
+  guint col, row;
+  gint n;
+
+  if (!tiles)
+    {
+      GdkRectangle all = {0, 0, cairo_image_surface_get_width (surface),
+			  cairo_image_surface_get_height (surface)};
+      drop = cairo_region_create_rectangle (&all);
+    }
+  else
+    {
+      drop = cairo_region_create ();
+      cairo_surface_flush (surface);
+
+      for (row = 0; row < tiles->rows; row++)
+	for (col = 0; col < tiles->cols; col++)
+	  {
+	    guint i = row * tiles->cols + col;
+	    GdkRectangle r;
+
+	    if (!tiles->populated[i])
+	      continue;
+
+	    tile_rect (tiles, col, row, &r);
+	    switch (cairo_region_contains_rectangle (keep, &r))
+	      {
+	      case CAIRO_REGION_OVERLAP_IN:
+		break;
+	      case CAIRO_REGION_OVERLAP_OUT:
+		release_tile (tiles, col, row);
+		set_populated (tiles, i, FALSE);
+		break;
+	      case CAIRO_REGION_OVERLAP_PART:
+		cairo_region_union_rectangle (drop, &r);
+		break;
+	      }
+	  }
+
+      cairo_surface_mark_dirty (surface);
+    }
+
+  cairo_region_subtract (drop, keep);
+  if (cairo_region_is_empty (drop))
+    {
+      cairo_region_destroy (drop);
+      return;
+    }
+
+  cr = cairo_create (surface);
+  for (n = 0; n < cairo_region_num_rectangles (drop); n++)
+    {
+      GdkRectangle r;
+      cairo_region_get_rectangle (drop, n, &r);
+      cairo_rectangle (cr, r.x, r.y, r.width, r.height);
+    }
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_fill (cr);
+  cairo_destroy (cr);
+
+  cairo_region_destroy (drop);
+}
+
+
+void tiled_surface_clear (cairo_surface_t *surface)
+{
+  GromitTiles *tiles = get_tiles (surface);
+  guint col, row;
+
+  if (!tiles)
+    {
+      cairo_t *cr = cairo_create (surface);
+      cairo_set_source_rgba (cr, 0, 0, 0, 0);
+      cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+      cairo_paint (cr);
+      cairo_destroy (cr);
+      return;
+    }
+
+  if (tiles->n_populated == 0)
+    return;
+
+  cairo_surface_flush (surface);
+
+  if (tiles->mapped)
+    madvise (tiles->pixels, tiles->size, MADV_DONTNEED);
+  else
+    for (row = 0; row < tiles->rows; row++)
+      for (col = 0; col < tiles->cols; col++)
+	if (tiles->populated[row * tiles->cols + col])
+	  release_tile (tiles, col, row);
+
+  memset (tiles->populated, 0, tiles->cols * tiles->rows);
+  tiles->n_populated = 0;
+
+  cairo_surface_mark_dirty (surface);
+}
+
+
+static void note_tile (const GdkRectangle *tile, gpointer user_data)
+{
+  *(gboolean *) user_data = FALSE;
+}
+
+
+gboolean tiled_surface_is_clear (cairo_surface_t *surface, const GdkRectangle *rect)
+{
+  gboolean clear = TRUE;
+  tiled_surface_foreach (surface, rect, note_tile, &clear);
+  return clear;
+}
+
+
+gsize tiled_surface_get_populated_bytes (cairo_surface_t *surface)
+{
+  GromitTiles *tiles = get_tiles (surface);
+
+  if (!tiles)
+    return (gsize) cairo_image_surface_get_stride (surface) * cairo_image_surface_get_height (surface);
+
+  return (gsize) tiles->n_populated * GROMIT_TILE_HEIGHT * TILE_ROW_BYTES;
+}
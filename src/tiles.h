@@ -0,0 +1,88 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef TILES_H
+#define TILES_H
+
+/*
+  Sparse screen-sized surfaces.
+
+  A tiled surface is an ordinary ARGB32 image surface, so cairo can draw
+  onto it as usual, but its pixels live in an anonymous mapping whose
+  rows are padded so that every tile column starts on a page boundary.
+  Memory for a tile is only committed by the kernel once something is
+  drawn into it and is handed back when the tile is cleared. Which tiles
+  hold pixels is tracked in a map attached to the surface, so that
+  copying, clearing and scanning only need to look at those.
+*/
+
+#include <glib.h>
+#include <gdk/gdk.h>
+
+/* 1024 ARGB32 pixels are exactly one 4 KiB page per tile row */
+#define GROMIT_TILE_WIDTH  1024
+#define GROMIT_TILE_HEIGHT 64
+
+typedef void (*GromitTileFunc) (const GdkRectangle *tile, gpointer user_data);
+
+cairo_surface_t *tiled_surface_create (gint width, gint height);
+
+/* Record that something was drawn into the given area. */
+void tiled_surface_mark (cairo_surface_t *surface, const GdkRectangle *rect);
+
+/*
+  Call func for every populated tile, clipped to clip if that is not NULL.
+  For surfaces that are not tiled, the whole surface counts as one tile.
+*/
+void tiled_surface_foreach (cairo_surface_t *surface,
+			    const GdkRectangle *clip,
+			    GromitTileFunc func,
+			    gpointer user_data);
+
+/* Make dst a copy of src, touching only tiles populated in either. */
+void tiled_surface_copy (cairo_surface_t *dst, cairo_surface_t *src);
+
+/*
+  Give surface a new size, dropping whatever falls outside. Populated
+  tiles stay in place, the pixel memory is remapped rather than copied
+  as long as the rows have room for the new width. surface is used up,
+  the returned one takes its place.
+*/
+cairo_surface_t *tiled_surface_resize (cairo_surface_t *surface, gint width, gint height);
+
+/*
+  Clear everything outside keep. Tiles entirely outside are given back,
+  tiles straddling its edge are cleared in part.
+*/
+void tiled_surface_clip (cairo_surface_t *surface, const cairo_region_t *keep);
+
+/* Clear the surface, giving all tile memory back. */
+void tiled_surface_clear (cairo_surface_t *surface);
+
+/* Whether no populated tile intersects rect, i.e. it is known to be transparent. */
+gboolean tiled_surface_is_clear (cairo_surface_t *surface, const GdkRectangle *rect);
+
+/* Number of bytes held by populated tiles. */
+gsize tiled_surface_get_populated_bytes (cairo_surface_t *surface);
+
+#endif
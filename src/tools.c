@@ -0,0 +1,163 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <string.h>
+
+#include "tools.h"
+#include "config.h"
+
+
+/*
+  Look up the tool for the given button and modifier bits, trying the
+  slave device's name, the master's and then the default one. names and
+  lens hold the three names, each followed by room for the "|Xy" suffix.
+*/
+static GromitPaintContext *lookup_tool (GromitData *data,
+					guchar **names,
+					guint *lens,
+					guint buttons,
+					guint modifier)
+{
+  GromitPaintContext *context;
+  guint k;
+
+  for (k = 0; k < 3; k++)
+    {
+      names[k][lens[k]] = 124;
+      names[k][lens[k] + 1] = buttons + 64;
+      names[k][lens[k] + 2] = modifier + 48;
+      names[k][lens[k] + 3] = 0;
+
+      if ((context = g_hash_table_lookup (data->tool_config, names[k])))
+	return context;
+    }
+
+  return NULL;
+}
+
+
+/* Later matches override earlier ones. */
+void tool_table_build (GromitData *data,
+		       GromitToolTable *table,
+		       const gchar *device_name,
+		       const gchar *slave_name)
+{
+  guchar *names[3];
+  guint lens[3];
+  guint req_buttons, req_modifier, i, j, k;
+  gint64 t0 = g_get_monotonic_time ();
+
+  lens[0] = strlen (slave_name);
+  names[0] = (guchar*) g_strndup (slave_name, lens[0] + 3);
+  lens[1] = strlen (device_name);
+  names[1] = (guchar*) g_strndup (device_name, lens[1] + 3);
+  lens[2] = strlen(DEFAULT_DEVICE_NAME);
+  names[2] = (guchar*) g_strndup (DEFAULT_DEVICE_NAME, lens[2] + 3);
+
+  for (req_buttons = 0; req_buttons < 32; req_buttons++)
+    for (req_modifier = 0; req_modifier < 8; req_modifier++)
+      {
+	GromitPaintContext *context = NULL, *found;
+
+	/*
+	  Go through all i up to req_buttons whose bits are _all_ in
+	  req_buttons. i == 0 handles the config cases where no button is
+	  given.
+	*/
+	for (i = 0; i <= req_buttons; i++)
+	  {
+	    if (i > 0 && (i & req_buttons) != i)
+	      continue;
+
+	    for (j = 0; ; j++)
+	      {
+		if ((found = lookup_tool (data, names, lens, i, req_modifier & ((1 << j) - 1))))
+		  context = found;
+		if (!(j <= 3 && req_modifier >= (1u << j)))
+		  break;
+	      }
+	  }
+
+	table->tools[req_buttons][req_modifier][0] = context;
+
+	/* the extra modifier only counts without other modifiers */
+	if (!req_modifier && (found = lookup_tool (data, names, lens, 0, 8)))
+	  context = found;
+	table->tools[req_buttons][req_modifier][1] = context;
+      }
+
+  for (k = 0; k < 3; k++)
+    g_free (names[k]);
+
+  table->generation = data->tool_generation;
+
+  GROMIT_DEBUG (data, GROMIT_LOG_TOOL, "Resolved tools for '%s' attached to '%s' in %" G_GINT64_FORMAT " us",
+	       slave_name, device_name, g_get_monotonic_time () - t0);
+}
+
+
+GromitToolTable *tool_table_get (GromitData *data,
+				 GromitDeviceData *devdata,
+				 GdkDevice *slave_device)
+{
+  GromitToolTable *table;
+
+  if (!devdata->tool_tables)
+    devdata->tool_tables = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+  table = g_hash_table_lookup (devdata->tool_tables, slave_device);
+  if (!table)
+    {
+      table = g_malloc (sizeof (GromitToolTable));
+      g_hash_table_insert (devdata->tool_tables, slave_device, table);
+    }
+  else if (table->generation == data->tool_generation)
+    return table;
+
+  tool_table_build (data, table, gdk_device_get_name (devdata->device),
+		    gdk_device_get_name (slave_device));
+  return table;
+}
+
+
+void tool_tables_prepare (GromitData *data, GromitDeviceData *devdata)
+{
+  GList *slaves, *s;
+
+  slaves = gdk_device_list_slave_devices (devdata->device);
+  for (s = slaves; s; s = s->next)
+    tool_table_get (data, devdata, s->data);
+  g_list_free (slaves);
+}
+
+
+GromitPaintContext *tool_table_lookup (GromitToolTable *table, guint state, gboolean extra)
+{
+  /* Extract Button/Modifiers from state (see GdkModifierType) */
+  guint req_buttons = (state >> 8) & 31;
+  guint req_modifier = (state >> 1) & 7;
+
+  if (state & GDK_SHIFT_MASK) req_modifier |= 1;
+
+  return table->tools[req_buttons][req_modifier][extra ? 1 : 0];
+}
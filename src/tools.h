@@ -0,0 +1,57 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef TOOLS_H
+#define TOOLS_H
+
+/*
+  Tool tables.
+
+  The tool for a device depends on its buttons, modifiers and the extra
+  modifier, looked up by the slave device's name, then the master's and
+  then the default one. A table resolves every combination of those once
+  per slave device, so that selecting a tool on a button press is a
+  single index. Tables are rebuilt whenever the config changed, see
+  GromitData's tool_generation.
+*/
+
+#include "main.h"
+
+/* Resolve all tools of a slave device attached to a master device. */
+void tool_table_build (GromitData *data,
+		       GromitToolTable *table,
+		       const gchar *device_name,
+		       const gchar *slave_name);
+
+/* The device's up to date table for slave_device, built if need be. */
+GromitToolTable *tool_table_get (GromitData *data,
+				 GromitDeviceData *devdata,
+				 GdkDevice *slave_device);
+
+/* Build the tables of all slaves currently attached to the device. */
+void tool_tables_prepare (GromitData *data, GromitDeviceData *devdata);
+
+/* The tool for a GdkModifierType state, NULL if none is configured. */
+GromitPaintContext *tool_table_lookup (GromitToolTable *table, guint state, gboolean extra);
+
+#endif
@@ -0,0 +1,390 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+#include "callbacks.h"
+
+G_STATIC_ASSERT (sizeof (GromitTraceHeader) == 16);
+G_STATIC_ASSERT (sizeof (GromitTraceRecord) == 28);
+G_STATIC_ASSERT (sizeof (GromitTraceCoord) == 16);
+
+struct _GromitTrace
+{
+  GArray  *history;      /* GromitTraceCoord */
+  guint    n_records;
+
+  /* recording */
+  FILE    *file;
+
+  /* replay */
+  gchar   *contents;
+  gsize    length;
+  gsize    offset;
+  gboolean fast;
+  gboolean dispatching;
+  guint32  first_time;
+  guint32  time_base;
+  gint64   start;
+};
+
+
+static GromitTrace *trace_new (void)
+{
+  GromitTrace *trace = g_new0 (GromitTrace, 1);
+  trace->history = g_array_new (FALSE, FALSE, sizeof (GromitTraceCoord));
+  return trace;
+}
+
+
+static void trace_free (GromitTrace *trace)
+{
+  g_array_free (trace->history, TRUE);
+  g_free (trace->contents);
+  g_free (trace);
+}
+
+
+gboolean trace_record_start (GromitData *data, const gchar *filename)
+{
+  GromitTraceHeader header = {GROMIT_TRACE_MAGIC, GROMIT_TRACE_VERSION, data->width, data->height};
+  FILE *file = fopen (filename, "wb");
+
+  if (!file || fwrite (&header, sizeof (header), 1, file) != 1)
+    {
+      g_printerr ("Could not write trace to %s\n", filename);
+      if (file)
+	fclose (file);
+      return FALSE;
+    }
+
+  data->recorder = trace_new ();
+  data->recorder->file = file;
+
+  GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "Recording input to %s", filename);
+
+  return TRUE;
+}
+
+
+void trace_record_stop (GromitData *data)
+{
+  if (!data->recorder)
+    return;
+
+  fclose (data->recorder->file);
+
+  GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "Recorded %u input events.", data->recorder->n_records);
+
+  trace_free (data->recorder);
+  data->recorder = NULL;
+}
+
+
+void trace_record_history (GromitData *data,
+			   gdouble x, gdouble y,
+			   gdouble pressure,
+			   guint32 time)
+{
+  GromitTraceCoord coord = {time, x, y, pressure};
+
+  if (data->recorder)
+    g_array_append_val (data->recorder->history, coord);
+}
+
+
+void trace_record_event (GromitData *data,
+			 GromitDeviceData *devdata,
+			 GromitTraceType type,
+			 GdkEvent *ev)
+{
+  GromitTrace *trace = data->recorder;
+  GromitTraceRecord record = {0};
+  gdouble x = 0, y = 0, pressure = 1;
+  GdkModifierType state = 0;
+  guint button = 0;
+
+  if (!trace)
+    return;
+
+  gdk_event_get_coords (ev, &x, &y);
+  gdk_event_get_axis (ev, GDK_AXIS_PRESSURE, &pressure);
+  gdk_event_get_state (ev, &state);
+  gdk_event_get_button (ev, &button);
+
+  record.type = type;
+  record.device = devdata->index;
+  record.n_history = MIN (trace->history->len, G_MAXUINT16);
+  record.time = gdk_event_get_time (ev);
+  record.x = x;
+  record.y = y;
+  record.pressure = pressure;
+  record.state = state;
+  record.button = button;
+
+  fwrite (&record, sizeof (record), 1, trace->file);
+  fwrite (trace->history->data, sizeof (GromitTraceCoord), record.n_history, trace->file);
+  g_array_set_size (trace->history, 0);
+  trace->n_records++;
+
+  /* have whole strokes on disk should we not exit cleanly */
+  if (type == GROMIT_TRACE_RELEASE)
+    fflush (trace->file);
+}
+
+
+static GromitDeviceData *device_by_index (GromitData *data, guint index)
+{
+  GHashTableIter it;
+  gpointer value;
+
+  g_hash_table_iter_init (&it, data->devdatatable);
+  while (g_hash_table_iter_next (&it, NULL, &value))
+    if (((GromitDeviceData *) value)->index == index)
+      return value;
+
+  return NULL;
+}
+
+
+/* Axes for the device as gdk_event_get_axis() expects them. */
+static gdouble *replay_axes (GdkDevice *device,
+			     gdouble x, gdouble y,
+			     gdouble pressure)
+{
+  gint i, n = gdk_device_get_n_axes (device);
+  gdouble *axes;
+
+  if (n <= 0)
+    return NULL;
+
+  axes = g_new0 (gdouble, n);
+  for (i = 0; i < n; i++)
+    switch (gdk_device_get_axis_use (device, i))
+      {
+      case GDK_AXIS_X:
+	axes[i] = x;
+	break;
+      case GDK_AXIS_Y:
+	axes[i] = y;
+	break;
+      case GDK_AXIS_PRESSURE:
+	axes[i] = pressure;
+	break;
+      default:
+	break;
+      }
+
+  return axes;
+}
+
+
+static void replay_event (GromitData *data,
+			  const GromitTraceRecord *record,
+			  const gchar *coords)
+{
+  GromitTrace *trace = data->replayer;
+  GromitDeviceData *devdata = device_by_index (data, record->device);
+  GdkWindow *window = gtk_widget_get_window (data->win);
+  guint32 shift;
+  GdkEvent *ev;
+  guint i;
+
+  if (!devdata)
+    {
+      GROMIT_DEBUG (data, GROMIT_LOG_INPUT, "No device %u to replay input of.", record->device);
+      return;
+    }
+
+  /* event times as if it happened now, so that latency is measured against them */
+  if (trace->fast)
+    shift = (guint32) (g_get_monotonic_time () / 1000) - record->time;
+  else
+    shift = trace->time_base - trace->first_time;
+
+  g_array_set_size (trace->history, 0);
+  for (i = 0; i < record->n_history; i++)
+    {
+      GromitTraceCoord coord;
+      memcpy (&coord, coords + i * sizeof (coord), sizeof (coord));
+      coord.time += shift;
+      g_array_append_val (trace->history, coord);
+    }
+
+  if (record->type == GROMIT_TRACE_MOTION)
+    {
+      ev = gdk_event_new (GDK_MOTION_NOTIFY);
+      ev->motion.window = g_object_ref (window);
+      ev->motion.time = record->time + shift;
+      ev->motion.x = ev->motion.x_root = record->x;
+      ev->motion.y = ev->motion.y_root = record->y;
+      ev->motion.axes = replay_axes (devdata->device, record->x, record->y, record->pressure);
+      ev->motion.state = record->state;
+    }
+  else
+    {
+      ev = gdk_event_new (record->type == GROMIT_TRACE_PRESS ? GDK_BUTTON_PRESS : GDK_BUTTON_RELEASE);
+      ev->button.window = g_object_ref (window);
+      ev->button.time = record->time + shift;
+      ev->button.x = ev->button.x_root = record->x;
+      ev->button.y = ev->button.y_root = record->y;
+      ev->button.axes = replay_axes (devdata->device, record->x, record->y, record->pressure);
+      ev->button.state = record->state;
+      ev->button.button = record->button;
+    }
+
+  gdk_event_set_device (ev, devdata->device);
+  /* only the master pointer is recorded, take the last slave that drew */
+  gdk_event_set_source_device (ev, devdata->lastslave ? devdata->lastslave : devdata->device);
+
+  trace->dispatching = TRUE;
+  switch (record->type)
+    {
+    case GROMIT_TRACE_PRESS:
+      on_buttonpress (data->win, &ev->button, data);
+      break;
+    case GROMIT_TRACE_MOTION:
+      on_motion (data->win, &ev->motion, data);
+      break;
+    default:
+      on_buttonrelease (data->win, &ev->button, data);
+      break;
+    }
+  trace->dispatching = FALSE;
+
+  gdk_event_free (ev);
+  trace->n_records++;
+}
+
+
+static void replay_finish (GromitData *data)
+{
+  GromitTrace *trace = data->replayer;
+
+  g_printerr ("Replayed %u input events in %.2f s.\n", trace->n_records,
+	      (g_get_monotonic_time () - trace->start) / (gdouble) G_USEC_PER_SEC);
+
+  trace_free (trace);
+  data->replayer = NULL;
+}
+
+
+static gboolean replay_step (gpointer user_data)
+{
+  GromitData *data = (GromitData *) user_data;
+  GromitTrace *trace = data->replayer;
+
+  while (trace->offset < trace->length)
+    {
+      GromitTraceRecord record;
+      gsize size;
+
+      if (trace->length - trace->offset < sizeof (record))
+	break;
+      memcpy (&record, trace->contents + trace->offset, sizeof (record));
+      size = sizeof (record) + record.n_history * sizeof (GromitTraceCoord);
+      if (trace->length - trace->offset < size)
+	break;
+
+      if (trace->n_records == 0)
+	trace->first_time = record.time;
+
+      if (!trace->fast)
+	{
+	  gint64 due = trace->start + (gint64) (guint32) (record.time - trace->first_time) * 1000;
+	  gint64 now = g_get_monotonic_time ();
+
+	  if (due > now)
+	    {
+	      g_timeout_add ((due - now) / 1000, replay_step, data);
+	      return G_SOURCE_REMOVE;
+	    }
+	}
+
+      replay_event (data, &record, trace->contents + trace->offset + sizeof (record));
+      trace->offset += size;
+
+      /* one event per main loop iteration, so frames get painted in between */
+      if (trace->fast)
+	return G_SOURCE_CONTINUE;
+    }
+
+  if (trace->offset < trace->length)
+    g_printerr ("Trace ends in a truncated record.\n");
+
+  replay_finish (data);
+  return G_SOURCE_REMOVE;
+}
+
+
+gboolean trace_replay_start (GromitData *data, const gchar *filename, gboolean fast)
+{
+  GromitTrace *trace = trace_new ();
+  GromitTraceHeader header;
+  GError *error = NULL;
+
+  if (!g_file_get_contents (filename, &trace->contents, &trace->length, &error))
+    {
+      g_printerr ("Could not read trace: %s\n", error->message);
+      g_error_free (error);
+      trace_free (trace);
+      return FALSE;
+    }
+
+  if (trace->length < sizeof (header))
+    memset (&header, 0, sizeof (header));
+  else
+    memcpy (&header, trace->contents, sizeof (header));
+
+  if (memcmp (header.magic, GROMIT_TRACE_MAGIC, 4) != 0 || header.version != GROMIT_TRACE_VERSION)
+    {
+      g_printerr ("%s is not a Gromit-MPX trace of version %d\n", filename, GROMIT_TRACE_VERSION);
+      trace_free (trace);
+      return FALSE;
+    }
+
+  if (header.width != data->width || header.height != data->height)
+    g_printerr ("Trace was recorded on a %ux%u screen, replaying on %ux%u.\n",
+		header.width, header.height, data->width, data->height);
+
+  trace->offset = sizeof (header);
+  trace->fast = fast;
+  trace->start = g_get_monotonic_time ();
+  trace->time_base = trace->start / 1000;
+  data->replayer = trace;
+
+  g_idle_add (replay_step, data);
+
+  return TRUE;
+}
+
+
+GArray *trace_replay_history (GromitData *data)
+{
+  if (!data->replayer || !data->replayer->dispatching)
+    return NULL;
+
+  return data->replayer->history;
+}
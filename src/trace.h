@@ -0,0 +1,94 @@
+/*
+ * Gromit-MPX -- a program for painting on the screen
+ *
+ * Gromit Copyright (C) 2000 Simon Budig <Simon.Budig@unix-ag.org>
+ *
+ * Gromit-MPX Copyright (C) 2009,2010 Christian Beier <dontmind@freeshell.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+  Input traces.
+
+  With --record, every button press, motion and release the input
+  handlers act on is written to a file, together with the motion history
+  they drew through. --replay feeds such a file back through the same
+  handlers, at the original pace or, with --replay-fast, as fast as they
+  take it, so that sessions can be profiled and builds compared on the
+  exact same input.
+
+  A trace is a GromitTraceHeader followed by records, each a
+  GromitTraceRecord followed by n_history GromitTraceCoords. All in the
+  byte order of the machine that recorded it.
+*/
+
+#include "main.h"
+
+#define GROMIT_TRACE_MAGIC   "GMXT"
+#define GROMIT_TRACE_VERSION 1
+
+typedef enum
+{
+  GROMIT_TRACE_PRESS,
+  GROMIT_TRACE_MOTION,
+  GROMIT_TRACE_RELEASE
+} GromitTraceType;
+
+typedef struct
+{
+  gchar   magic[4];
+  guint32 version;
+  guint32 width;
+  guint32 height;
+} GromitTraceHeader;
+
+typedef struct
+{
+  guint8  type;
+  guint8  device;     /* index of the master pointer, see GromitDeviceData */
+  guint16 n_history;
+  guint32 time;
+  gfloat  x;
+  gfloat  y;
+  gfloat  pressure;   /* 1 for devices without pressure */
+  guint32 state;
+  guint32 button;
+} GromitTraceRecord;
+
+typedef struct
+{
+  guint32 time;
+  gfloat  x;
+  gfloat  y;
+  gfloat  pressure;
+} GromitTraceCoord;
+
+gboolean trace_record_start (GromitData *data, const gchar *filename);
+void trace_record_stop (GromitData *data);
+/* Note a history point the current motion event was drawn through. */
+void trace_record_history (GromitData *data, gdouble x, gdouble y, gdouble pressure, guint32 time);
+/* Write an event along with the history noted for it. */
+void trace_record_event (GromitData *data, GromitDeviceData *devdata, GromitTraceType type, GdkEvent *ev);
+
+gboolean trace_replay_start (GromitData *data, const gchar *filename, gboolean fast);
+/* The history of the motion event being replayed, NULL when not replaying. */
+GArray *trace_replay_history (GromitData *data);
+
+#endif